@@ -0,0 +1,25 @@
+// Replaces the global operator new so that Profile can count heap
+// allocations. It's linked into msdscript and msdscript_bench rather
+// than the library, which mustn't replace the allocator of the
+// program it's embedded in.
+
+#include <cstdlib>
+#include <new>
+
+#include "profile.hpp"
+
+void *operator new(size_t size) {
+    if (Profile::count_allocations)
+        Profile::note_allocation();
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
@@ -0,0 +1,264 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "expr.hpp"
+#include "value.hpp"
+#include "env.hpp"
+#include "symbol.hpp"
+
+// Rows per block: enough to pay for walking the tree, few enough
+// that every node's values for the block stay in cache
+static const size_t block_size = 1024;
+
+// An input column that `e` uses
+struct Input {
+    int sym;
+    std::string name;
+    Column column;
+};
+
+// A variable's values for the rows of the current block
+struct Binding {
+    int sym;
+    bool booleans;
+    const int64_t *values;
+};
+
+//=====================================================
+// The kernels, each a loop over a block with no branches, so that
+// it vectorizes. Each stores its result over `a`.
+
+// Returns whether any row overflowed
+static bool add_kernel(int64_t *a, const int64_t *b, size_t n) {
+    uint64_t overflow = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t sum = (uint64_t)a[i] + (uint64_t)b[i];
+        // overflowed if the sum's sign differs from both operands'
+        overflow |= ((uint64_t)a[i] ^ sum) & ((uint64_t)b[i] ^ sum);
+        a[i] = (int64_t)sum;
+    }
+    return overflow >> 63;
+}
+
+// Returns whether any row overflowed
+static bool mult_kernel(int64_t *a, const int64_t *b, size_t n) {
+    bool overflow = false;
+    for (size_t i = 0; i < n; i++)
+        overflow |= __builtin_mul_overflow(a[i], b[i], &a[i]);
+    return overflow;
+}
+
+static void normalize_kernel(int64_t *a, const int64_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        a[i] = b[i] != 0;
+}
+
+static void compare_kernel(int64_t *a, const int64_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        a[i] = a[i] == b[i];
+}
+
+// Keeps `a[i]` where `mask[i]` is true and takes `b[i]` elsewhere
+static void select_kernel(int64_t *a, const int64_t *b, const int64_t *mask, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        // all ones where the mask is true, so selecting needs no branch
+        int64_t keep = -(int64_t)(mask[i] != 0);
+        a[i] = (a[i] & keep) | (b[i] & ~keep);
+    }
+}
+
+static size_t count_true(const int64_t *mask, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += mask[i] != 0;
+    return count;
+}
+
+//=====================================================
+
+// Evaluates `e` over the `n` rows of a block with the variables in
+// `scope`, innermost last, storing the values in `out` and setting
+// `booleans` to their kind. Returns false, leaving `out` undefined,
+// if the block has to be evaluated row by row: when `e` has a
+// function or call, a number that doesn't fit, an overflow, an
+// operand of the wrong kind, or a variable that isn't bound.
+static bool eval_block(PTR(Expr) const &e, std::vector<Binding> &scope, size_t n,
+                       bool &booleans, int64_t *out) {
+    if (PTR(NumExpr) num = CAST(NumExpr)(e)) {
+        if (!num->rep.is_small())
+            return false;
+        booleans = false;
+        std::fill(out, out + n, num->rep.small_value());
+        return true;
+    }
+
+    if (PTR(BoolExpr) b = CAST(BoolExpr)(e)) {
+        booleans = true;
+        std::fill(out, out + n, (int64_t)b->rep);
+        return true;
+    }
+
+    if (PTR(VarExpr) v = CAST(VarExpr)(e)) {
+        for (size_t i = scope.size(); i-- > 0; ) {
+            if (scope[i].sym == v->sym) {
+                booleans = scope[i].booleans;
+                // a boolean column may hold any nonzero value for true,
+                // but the kernels need 0 or 1
+                if (booleans)
+                    normalize_kernel(out, scope[i].values, n);
+                else
+                    std::copy(scope[i].values, scope[i].values + n, out);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    PTR(Expr) lhs = nullptr;
+    PTR(Expr) rhs = nullptr;
+    if (PTR(AddExpr) a = CAST(AddExpr)(e)) {
+        lhs = a->lhs;
+        rhs = a->rhs;
+    } else if (PTR(MultExpr) m = CAST(MultExpr)(e)) {
+        lhs = m->lhs;
+        rhs = m->rhs;
+    } else if (PTR(CompareExpr) c = CAST(CompareExpr)(e)) {
+        lhs = c->lhs;
+        rhs = c->rhs;
+    }
+    if (lhs != nullptr) {
+        std::vector<int64_t> rhs_values(n);
+        bool lhs_booleans, rhs_booleans;
+        if (!eval_block(lhs, scope, n, lhs_booleans, out)
+            || !eval_block(rhs, scope, n, rhs_booleans, rhs_values.data()))
+            return false;
+        if (CAST(CompareExpr)(e) != nullptr) {
+            booleans = true;
+            // a number never equals a boolean
+            if (lhs_booleans != rhs_booleans)
+                std::fill(out, out + n, 0);
+            else
+                compare_kernel(out, rhs_values.data(), n);
+            return true;
+        }
+        if (lhs_booleans || rhs_booleans)
+            return false;
+        booleans = false;
+        if (CAST(AddExpr)(e) != nullptr)
+            return !add_kernel(out, rhs_values.data(), n);
+        return !mult_kernel(out, rhs_values.data(), n);
+    }
+
+    if (PTR(IfExpr) i = CAST(IfExpr)(e)) {
+        std::vector<int64_t> mask(n);
+        bool mask_booleans;
+        if (!eval_block(i->condition, scope, n, mask_booleans, mask.data()))
+            return false;
+        // only a branch that some row takes, so that a branch that
+        // would fail in every row doesn't stop the block
+        size_t taken = count_true(mask.data(), n);
+        if (taken == n)
+            return eval_block(i->then_part, scope, n, booleans, out);
+        if (taken == 0)
+            return eval_block(i->else_part, scope, n, booleans, out);
+        std::vector<int64_t> else_values(n);
+        bool else_booleans;
+        if (!eval_block(i->then_part, scope, n, booleans, out)
+            || !eval_block(i->else_part, scope, n, else_booleans, else_values.data())
+            || booleans != else_booleans)
+            return false;
+        select_kernel(out, else_values.data(), mask.data(), n);
+        return true;
+    }
+
+    if (PTR(LetExpr) l = CAST(LetExpr)(e)) {
+        std::vector<int64_t> values(n);
+        bool value_booleans;
+        if (!eval_block(l->rhs, scope, n, value_booleans, values.data()))
+            return false;
+        scope.push_back({l->var_sym, value_booleans, values.data()});
+        bool ok = eval_block(l->body, scope, n, booleans, out);
+        scope.pop_back();
+        return ok;
+    }
+
+    return false;
+}
+
+// Evaluates row `row` with `interp`, returning its result and
+// setting `booleans` to its kind
+static int64_t interp_row(PTR(Expr) const &e, const std::vector<Input> &inputs,
+                          size_t row, bool &booleans) {
+    PTR(Env) env = Env::empty;
+    for (const Input &input : inputs) {
+        int64_t value = input.column.values[row];
+        PTR(Val) val = nullptr;
+        if (input.column.booleans)
+            val = NEW(BoolVal)(value != 0);
+        else
+            val = NEW(NumVal)(value);
+        env = NEW(ExtendedEnv)(env, input.name, input.sym, val);
+    }
+    PTR(Val) result = e->interp(env);
+    if (PTR(NumVal) n = CAST(NumVal)(result)) {
+        if (!n->rep.is_small())
+            throw std::runtime_error("number out of range: " + n->rep.to_string());
+        booleans = false;
+        return n->rep.small_value();
+    }
+    if (PTR(BoolVal) b = CAST(BoolVal)(result)) {
+        booleans = true;
+        return b->rep;
+    }
+    throw std::runtime_error("result isn't a number or boolean");
+}
+
+static std::runtime_error row_error(size_t row, const std::string &why) {
+    return std::runtime_error("row " + std::to_string(row) + ": " + why);
+}
+
+// Checks that results starting at `row` are of the same kind as the
+// ones before, where `kind` is -1 until there are some
+static void check_kind(int &kind, bool booleans, size_t row) {
+    if (kind == -1)
+        kind = booleans;
+    else if (kind != (int)booleans)
+        throw row_error(row, "results aren't all numbers or all booleans");
+}
+
+bool interp_batch(PTR(Expr) e, const Columns &columns, size_t rows, int64_t *results) {
+    // only the inputs `e` uses, interned once
+    std::vector<Input> inputs;
+    for (int id : e->free_vars.ids()) {
+        std::string name = Symbol::name(id);
+        auto found = columns.find(name);
+        if (found != columns.end())
+            inputs.push_back({id, name, found->second});
+    }
+
+    int kind = -1;
+    std::vector<Binding> scope;
+    for (size_t start = 0; start < rows; start += block_size) {
+        size_t n = std::min(block_size, rows - start);
+        scope.clear();
+        for (const Input &input : inputs)
+            scope.push_back({input.sym, input.column.booleans, input.column.values + start});
+        bool booleans;
+        if (eval_block(e, scope, n, booleans, results + start)) {
+            check_kind(kind, booleans, start);
+            continue;
+        }
+        for (size_t row = start; row < start + n; row++) {
+            try {
+                results[row] = interp_row(e, inputs, row, booleans);
+            } catch (std::runtime_error &ex) {
+                throw row_error(row, ex.what());
+            }
+            check_kind(kind, booleans, row);
+        }
+    }
+    return kind == 1;
+}
@@ -0,0 +1,44 @@
+#ifndef batch_hpp
+#define batch_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+
+#include "pointer.hpp"
+
+class Expr;
+
+// Columnar evaluation: one expression over many rows of inputs, with
+// each node run over a whole block of rows at a time by a loop that
+// the compiler can vectorize, instead of `interp` once per row.
+
+// An input to `interp_batch`: one value per row, all numbers or all
+// booleans (as 0 for false and anything else for true). The values
+// aren't copied.
+struct Column {
+    bool booleans;
+    const int64_t *values;
+};
+
+// Columns by input name
+typedef std::map<std::string, Column> Columns;
+
+// Evaluates `e` for each of `rows` rows, as `interp` would with row
+// i's inputs bound to entry i of `columns`, and stores row i's
+// result in `results[i]`. Returns whether the results are booleans
+// (as 0 or 1) rather than numbers. Throws `runtime_error`, naming
+// the row, if a row fails, and also if a result is a function or
+// doesn't fit in 64 bits, or results aren't all of one kind.
+//
+// Numbers, booleans, variables, `+`, `*`, `==`, `_if` and `_let`
+// run as kernels. `_if` evaluates only the branch that every row of
+// a block takes, or, if the rows differ, both branches, selecting
+// per row.
+// A block whose rows need anything else, or overflow, or mix kinds,
+// is evaluated row by row with `interp` instead, so the results and
+// errors are always the same as interp's.
+bool interp_batch(PTR(Expr) e, const Columns &columns, size_t rows, int64_t *results);
+
+#endif /* batch_hpp */
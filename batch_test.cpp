@@ -0,0 +1,81 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "env.hpp"
+#include "expr.hpp"
+#include "parse.hpp"
+#include "value.hpp"
+
+// More than one block, so that the second block starts partway
+// through the columns
+static const size_t rows = 1500;
+
+static PTR(Expr) parse_program(const std::string &source) {
+    std::istringstream in(source);
+    return parse(in);
+}
+
+// Row `row`'s result from `interp`, with booleans as 0 or 1
+static int64_t scalar(PTR(Expr) e, const Columns &columns, size_t row, bool &booleans) {
+    PTR(Env) env = Env::empty;
+    for (const auto &column : columns) {
+        int64_t value = column.second.values[row];
+        PTR(Val) val = nullptr;
+        if (column.second.booleans)
+            val = NEW(BoolVal)(value != 0);
+        else
+            val = NEW(NumVal)(value);
+        env = NEW(ExtendedEnv)(env, column.first, val);
+    }
+    PTR(Val) result = e->interp(env);
+    if (PTR(BoolVal) b = CAST(BoolVal)(result)) {
+        booleans = true;
+        return b->rep;
+    }
+    booleans = false;
+    return CAST(NumVal)(result)->rep.small_value();
+}
+
+TEST_CASE("interp_batch agrees with interp") {
+    // booleans that aren't all stored as 1 for true
+    std::vector<int64_t> b(rows), c(rows), n(rows);
+    for (size_t i = 0; i < rows; i++) {
+        b[i] = (int64_t)(i % 5) - 2;
+        c[i] = (int64_t)(i % 3) * 7;
+        n[i] = (int64_t)(i % 11) - 5;
+    }
+    Columns columns = {
+        {"b", {true, b.data()}},
+        {"c", {true, c.data()}},
+        {"n", {false, n.data()}},
+    };
+
+    const char *programs[] = {
+        "b",
+        "b == c",
+        "b == _true",
+        "(b == c) == (n == 2)",
+        "_let x = b _in x == (n == n)",
+        "_if b _then n * 3 _else n + 7",
+        "_if b == c _then n _else 0",
+        // runs row by row
+        "(_fun (x) x == c)(b)",
+    };
+    for (const char *source : programs) {
+        INFO(source);
+        PTR(Expr) e = parse_program(source);
+        std::vector<int64_t> results(rows);
+        bool booleans = interp_batch(e, columns, rows, results.data());
+        for (size_t row = 0; row < rows; row++) {
+            INFO("row " << row);
+            bool scalar_booleans;
+            int64_t expected = scalar(e, columns, row, scalar_booleans);
+            REQUIRE(booleans == scalar_booleans);
+            REQUIRE(results[row] == expected);
+        }
+    }
+}
@@ -0,0 +1,177 @@
+// msdscript_bench: times parse, optimize, interp and interp_by_steps
+// over seeded corpora of random programs and prints the results as
+// JSON, so that runs can be compared between releases. The
+// "scheduled" phase runs a whole corpus at once on a Scheduler with a
+// thread per core, and "interp_parallel" is interp with Parallel
+// forking operands across the cores; allocations on other threads
+// aren't counted.
+//
+// To compare PTR backends, build it with each MSDSCRIPT_POINTER and
+// run them with the same seed; the output says which one it used.
+//
+//   msdscript_bench [--seed N] [--programs N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parse.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "env.hpp"
+#include "step.hpp"
+#include "profile.hpp"
+#include "stats.hpp"
+#include "random_expr.hpp"
+#include "scheduler.hpp"
+#include "parallel.hpp"
+
+struct Corpus {
+    const char *shape;
+    int depth;
+    std::string (*generate)(int);
+};
+
+struct PhaseResult {
+    long long ns = 0;
+    unsigned long allocations = 0;
+    unsigned long copies = 0;
+    int errors = 0;
+};
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs `phase` on each program, counting the ones that throw
+static PhaseResult run_phase(size_t programs, const std::function<void(size_t)> &phase) {
+    PhaseResult result;
+    unsigned long start_allocations = Profile::allocations();
+    unsigned long start_copies = Stats::copies();
+    long long start = now_ns();
+    for (size_t i = 0; i < programs; i++) {
+        try {
+            phase(i);
+        } catch (std::runtime_error &) {
+            result.errors++;
+        }
+    }
+    result.ns = now_ns() - start;
+    result.allocations = Profile::allocations() - start_allocations;
+    result.copies = Stats::copies() - start_copies;
+    return result;
+}
+
+static void print_phase(const char *name, PhaseResult result, size_t programs, bool last) {
+    printf("        \"%s\": {\"ns_per_program\": %.1f, \"allocs_per_program\": %.1f, "
+           "\"copies_per_program\": %.1f, \"errors\": %d}%s\n",
+           name, (double)result.ns / programs, (double)result.allocations / programs,
+           (double)result.copies / programs, result.errors, last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+    unsigned seed = 1;
+    size_t programs = 200;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--programs") == 0 && i + 1 < argc)
+            programs = (size_t)atoi(argv[++i]);
+        else {
+            std::cerr << "usage: msdscript_bench [--seed N] [--programs N]\n";
+            return 1;
+        }
+    }
+    if (programs == 0)
+        programs = 1;
+
+    std::vector<Corpus> corpora = {
+        {"arith", 1, random_expr},
+        {"arith", 2, random_expr},
+        {"arith", 3, random_expr},
+        {"arith", 4, random_expr},
+        {"fun", 1, random_fun_program},
+        {"fun", 2, random_fun_program},
+        {"recursion", 10, random_recursive_program},
+        {"recursion", 100, random_recursive_program},
+        {"recursion", 1000, random_recursive_program},
+    };
+
+    int threads = (int)std::thread::hardware_concurrency();
+    Profile::count_allocations = true;
+    Stats::enabled = true;
+    printf("{\n  \"seed\": %u,\n  \"programs\": %zu,\n  \"pointer\": \"%s\",\n  \"corpora\": [\n",
+           seed, programs, PTR_BACKEND);
+    for (size_t c = 0; c < corpora.size(); c++) {
+        const Corpus &corpus = corpora[c];
+        srand(seed + (unsigned)c);
+        std::vector<std::string> sources;
+        size_t bytes = 0;
+        for (size_t i = 0; i < programs; i++) {
+            sources.push_back(corpus.generate(corpus.depth));
+            bytes += sources.back().size();
+        }
+
+        std::vector<PTR(Expr)> parsed(programs);
+        PhaseResult parse_result = run_phase(programs, [&](size_t i) {
+            std::istringstream in(sources[i]);
+            parsed[i] = parse(in);
+        });
+        long nodes = 0;
+        for (PTR(Expr) e : parsed)
+            nodes += e->size;
+
+        PhaseResult optimize_result = run_phase(programs, [&](size_t i) {
+            parsed[i]->optimize();
+        });
+        PhaseResult interp_result = run_phase(programs, [&](size_t i) {
+            parsed[i]->interp(Env::empty);
+        });
+        Parallel::enabled = true;
+        PhaseResult parallel_result = run_phase(programs, [&](size_t i) {
+            parsed[i]->interp(Env::empty);
+        });
+        Parallel::enabled = false;
+        PhaseResult step_result = run_phase(programs, [&](size_t i) {
+            Step::interp_by_steps(parsed[i]);
+        });
+        // every program at once, as interp_by_steps tasks on all cores
+        std::vector<PTR(Task)> tasks(programs);
+        PhaseResult scheduled_result = run_phase(1, [&](size_t) {
+            Scheduler scheduler(threads);
+            for (size_t i = 0; i < programs; i++)
+                tasks[i] = scheduler.spawn(parsed[i]);
+        });
+        for (PTR(Task) task : tasks) {
+            try {
+                task->wait();
+            } catch (std::runtime_error &) {
+                scheduled_result.errors++;
+            }
+        }
+
+        printf("    {\n      \"shape\": \"%s\",\n      \"depth\": %d,\n", corpus.shape, corpus.depth);
+        printf("      \"bytes_per_program\": %.1f,\n      \"nodes_per_program\": %.1f,\n",
+               (double)bytes / programs, (double)nodes / programs);
+        printf("      \"phases\": {\n");
+        print_phase("parse", parse_result, programs, false);
+        print_phase("optimize", optimize_result, programs, false);
+        print_phase("interp", interp_result, programs, false);
+        print_phase("interp_parallel", parallel_result, programs, false);
+        print_phase("interp_by_steps", step_result, programs, false);
+        printf("        \"scheduled\": {\"ns_per_program\": %.1f, \"threads\": %d, \"errors\": %d}\n",
+               (double)scheduled_result.ns / programs, threads, scheduled_result.errors);
+        printf("      }\n    }%s\n", c + 1 == corpora.size() ? "" : ",");
+    }
+    printf("  ]\n}\n");
+    // as in main, so that static PTRs freed at exit aren't counted
+    Stats::enabled = false;
+    return 0;
+}
@@ -0,0 +1,36 @@
+# Runs msdscript_bench on a few programs and checks that it exits
+# cleanly with JSON that parses and covers every corpus. Run by ctest
+# as cmake -DBENCH=<path to msdscript_bench> -P bench_smoke.cmake;
+# parsing JSON needs CMake 3.19.
+cmake_minimum_required(VERSION 3.19)
+
+execute_process(
+    COMMAND ${BENCH} --seed 1 --programs 2
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "msdscript_bench exited with ${result}:\n${errors}")
+endif()
+
+string(JSON programs ERROR_VARIABLE json_error GET "${output}" programs)
+if(json_error)
+    message(FATAL_ERROR "msdscript_bench printed bad JSON: ${json_error}\n${output}")
+endif()
+if(NOT programs EQUAL 2)
+    message(FATAL_ERROR "msdscript_bench ran ${programs} programs, not 2")
+endif()
+
+string(JSON corpora LENGTH "${output}" corpora)
+if(corpora EQUAL 0)
+    message(FATAL_ERROR "msdscript_bench ran no corpora")
+endif()
+math(EXPR last "${corpora} - 1")
+foreach(i RANGE ${last})
+    # the last phase, so the corpus was printed to the end
+    string(JSON ns ERROR_VARIABLE json_error GET "${output}" corpora ${i} phases scheduled ns_per_program)
+    if(json_error)
+        message(FATAL_ERROR "msdscript_bench corpus ${i} is incomplete: ${json_error}")
+    endif()
+endforeach()
@@ -0,0 +1,721 @@
+#include "checkpoint.hpp"
+
+#include <stdint.h>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "expr.hpp"
+#include "value.hpp"
+#include "env.hpp"
+#include "cont.hpp"
+#include "step.hpp"
+#include "symbol.hpp"
+
+// A checkpoint is the magic string, then one record per string and
+// per object, each object after the objects it refers to, then the
+// registers. A record is a tag byte and its fields. Numbers are
+// LEB128 varints, zigzag-encoded when signed, and references are
+// varint ids counting records of that table from 0.
+static const char magic[] = "MSDSCKP2";
+
+enum Tag {
+    string_tag = 1,
+    num_expr_tag = 10, bool_expr_tag, var_expr_tag, add_expr_tag, mult_expr_tag,
+    compare_expr_tag, let_expr_tag, if_expr_tag, fun_expr_tag, call_expr_tag, big_num_expr_tag,
+    empty_env_tag = 30, extended_env_tag, closure_env_tag, call_env_tag,
+    num_val_tag = 40, bool_val_tag, fun_val_tag, big_num_val_tag,
+    done_cont_tag = 50, right_then_add_cont_tag, add_cont_tag, right_then_mult_cont_tag,
+    mult_cont_tag, let_body_cont_tag, if_branch_cont_tag, arg_then_call_cont_tag,
+    call_cont_tag, right_then_comp_cont_tag, comp_cont_tag,
+    state_tag = 70
+};
+
+// An object to write, as a pointer to its base class
+struct Ref {
+    enum { expr, env, val, cont } table;
+    void *p;
+};
+
+class CheckpointWriter {
+public:
+    CheckpointWriter(std::ostream &_out) : out(_out) { }
+
+    // Writes `root` and everything it refers to that isn't written
+    // yet, returning its id
+    uint64_t object(Ref root);
+    void uint(uint64_t n);
+    void sint(int64_t n);
+
+private:
+    std::ostream &out;
+    std::unordered_map<void *, uint64_t> ids;
+    uint64_t next_id = 0;
+    std::unordered_map<std::string, uint64_t> string_ids;
+    // the fields of the record being written
+    std::vector<uint64_t> fields;
+
+    uint64_t string(const std::string &s);
+    // Adds the string ids of `params`' names to `fields`, before the
+    // record that lists them
+    void params(PTR(ParamList) params);
+    // Writes a count and then the ids of `items`
+    void list(const std::vector<uint64_t> &items);
+    template <class T> void list(const std::vector<T> &items);
+    std::vector<Ref> children(Ref r);
+    void write(Ref r);
+    uint64_t id(Expr *e) { return ids.at(e); }
+    uint64_t id(Env *e) { return ids.at(e); }
+    uint64_t id(Val *v) { return ids.at(v); }
+    uint64_t id(Cont *c) { return ids.at(c); }
+};
+
+void CheckpointWriter::uint(uint64_t n) {
+    while (n >= 0x80) {
+        out.put((char)(n | 0x80));
+        n >>= 7;
+    }
+    out.put((char)n);
+}
+
+void CheckpointWriter::sint(int64_t n) {
+    uint(((uint64_t)n << 1) ^ (uint64_t)(n >> 63));
+}
+
+uint64_t CheckpointWriter::string(const std::string &s) {
+    auto found = string_ids.find(s);
+    if (found != string_ids.end())
+        return found->second;
+    out.put(string_tag);
+    uint(s.size());
+    out.write(s.data(), s.size());
+    uint64_t id = string_ids.size();
+    string_ids[s] = id;
+    return id;
+}
+
+void CheckpointWriter::params(PTR(ParamList) params) {
+    for (const std::string &name : params->names)
+        fields.push_back(string(name));
+}
+
+void CheckpointWriter::list(const std::vector<uint64_t> &items) {
+    uint(items.size());
+    for (uint64_t item : items)
+        uint(item);
+}
+
+template <class T>
+void CheckpointWriter::list(const std::vector<T> &items) {
+    uint(items.size());
+    for (T const &item : items)
+        uint(id(RAW(item)));
+}
+
+static Ref expr_ref(PTR(Expr) e) { return {Ref::expr, RAW(e)}; }
+static Ref env_ref(PTR(Env) e) { return {Ref::env, RAW(e)}; }
+static Ref val_ref(PTR(Val) v) { return {Ref::val, RAW(v)}; }
+static Ref cont_ref(PTR(Cont) c) { return {Ref::cont, RAW(c)}; }
+
+std::vector<Ref> CheckpointWriter::children(Ref r) {
+    if (r.table == Ref::expr) {
+        Expr *e = (Expr *)r.p;
+        if (AddExpr *a = dynamic_cast<AddExpr *>(e))
+            return {expr_ref(a->lhs), expr_ref(a->rhs)};
+        if (MultExpr *m = dynamic_cast<MultExpr *>(e))
+            return {expr_ref(m->lhs), expr_ref(m->rhs)};
+        if (CompareExpr *c = dynamic_cast<CompareExpr *>(e))
+            return {expr_ref(c->lhs), expr_ref(c->rhs)};
+        if (LetExpr *l = dynamic_cast<LetExpr *>(e))
+            return {expr_ref(l->rhs), expr_ref(l->body)};
+        if (IfExpr *i = dynamic_cast<IfExpr *>(e))
+            return {expr_ref(i->condition), expr_ref(i->then_part), expr_ref(i->else_part)};
+        if (FunExpr *f = dynamic_cast<FunExpr *>(e))
+            return {expr_ref(f->body)};
+        if (CallExpr *c = dynamic_cast<CallExpr *>(e)) {
+            std::vector<Ref> refs = {expr_ref(c->to_be_called)};
+            for (PTR(Expr) const &arg : c->actual_args)
+                refs.push_back(expr_ref(arg));
+            return refs;
+        }
+        return {};
+    }
+    if (r.table == Ref::env) {
+        if (ExtendedEnv *x = dynamic_cast<ExtendedEnv *>((Env *)r.p))
+            return {env_ref(x->rest), val_ref(x->val)};
+        std::vector<Ref> refs;
+        if (CallEnv *x = dynamic_cast<CallEnv *>((Env *)r.p)) {
+            refs.push_back(env_ref(x->rest));
+            for (size_t i = 0; i < x->params->names.size(); i++)
+                refs.push_back(val_ref(x->val(i)));
+        }
+        if (ClosureEnv *x = dynamic_cast<ClosureEnv *>((Env *)r.p))
+            for (size_t i = 0; i < x->captures->names.size(); i++)
+                if (x->val(i) != nullptr)
+                    refs.push_back(val_ref(x->val(i)));
+        return refs;
+    }
+    if (r.table == Ref::val) {
+        if (FunVal *f = dynamic_cast<FunVal *>((Val *)r.p))
+            return {expr_ref(f->body), env_ref(f->env)};
+        return {};
+    }
+    Cont *c = (Cont *)r.p;
+    if (RightThenAddCont *k = dynamic_cast<RightThenAddCont *>(c))
+        return {expr_ref(k->rhs), env_ref(k->env), cont_ref(k->rest)};
+    if (AddCont *k = dynamic_cast<AddCont *>(c))
+        return {val_ref(k->lhs_val), cont_ref(k->rest)};
+    if (RightThenMultCont *k = dynamic_cast<RightThenMultCont *>(c))
+        return {expr_ref(k->rhs), env_ref(k->env), cont_ref(k->rest)};
+    if (MultCont *k = dynamic_cast<MultCont *>(c))
+        return {val_ref(k->lhs_val), cont_ref(k->rest)};
+    if (LetBodyCont *k = dynamic_cast<LetBodyCont *>(c))
+        return {expr_ref(k->body), env_ref(k->env), cont_ref(k->rest)};
+    if (IfBranchCont *k = dynamic_cast<IfBranchCont *>(c))
+        return {expr_ref(k->then_part), expr_ref(k->else_part), env_ref(k->env), cont_ref(k->rest)};
+    if (ArgThenCallCont *k = dynamic_cast<ArgThenCallCont *>(c)) {
+        std::vector<Ref> refs = {env_ref(k->env), cont_ref(k->rest)};
+        for (PTR(Expr) const &arg : k->actual_args)
+            refs.push_back(expr_ref(arg));
+        return refs;
+    }
+    if (CallCont *k = dynamic_cast<CallCont *>(c)) {
+        std::vector<Ref> refs = {val_ref(k->to_be_called_val), env_ref(k->env), cont_ref(k->rest)};
+        for (PTR(Val) const &v : k->arg_vals)
+            refs.push_back(val_ref(v));
+        for (PTR(Expr) const &arg : k->actual_args)
+            refs.push_back(expr_ref(arg));
+        return refs;
+    }
+    if (RightThenCompCont *k = dynamic_cast<RightThenCompCont *>(c))
+        return {expr_ref(k->rhs), env_ref(k->env), cont_ref(k->rest)};
+    if (CompCont *k = dynamic_cast<CompCont *>(c))
+        return {val_ref(k->lhs_val), cont_ref(k->rest)};
+    if (MemoCont *k = dynamic_cast<MemoCont *>(c))
+        return {cont_ref(k->rest)};
+    if (TraceEndCont *k = dynamic_cast<TraceEndCont *>(c))
+        return {cont_ref(k->rest)};
+    return {};
+}
+
+// Writes the record for `r`, whose children all have ids
+void CheckpointWriter::write(Ref r) {
+    fields.clear();
+    if (r.table == Ref::expr) {
+        Expr *e = (Expr *)r.p;
+        if (NumExpr *n = dynamic_cast<NumExpr *>(e)) {
+            if (n->rep.is_small()) {
+                out.put(num_expr_tag);
+                sint(n->rep.small_value());
+            } else {
+                uint64_t digits = string(n->rep.to_string());
+                out.put(big_num_expr_tag);
+                uint(digits);
+            }
+        } else if (BoolExpr *b = dynamic_cast<BoolExpr *>(e)) {
+            out.put(bool_expr_tag);
+            uint(b->rep);
+        } else if (VarExpr *v = dynamic_cast<VarExpr *>(e)) {
+            uint64_t name = string(v->name);
+            out.put(var_expr_tag);
+            uint(name);
+        } else if (AddExpr *a = dynamic_cast<AddExpr *>(e)) {
+            out.put(add_expr_tag);
+            uint(id(RAW(a->lhs)));
+            uint(id(RAW(a->rhs)));
+        } else if (MultExpr *m = dynamic_cast<MultExpr *>(e)) {
+            out.put(mult_expr_tag);
+            uint(id(RAW(m->lhs)));
+            uint(id(RAW(m->rhs)));
+        } else if (CompareExpr *c = dynamic_cast<CompareExpr *>(e)) {
+            out.put(compare_expr_tag);
+            uint(id(RAW(c->lhs)));
+            uint(id(RAW(c->rhs)));
+        } else if (LetExpr *l = dynamic_cast<LetExpr *>(e)) {
+            uint64_t name = string(l->varStr);
+            out.put(let_expr_tag);
+            uint(name);
+            uint(id(RAW(l->rhs)));
+            uint(id(RAW(l->body)));
+        } else if (IfExpr *i = dynamic_cast<IfExpr *>(e)) {
+            out.put(if_expr_tag);
+            uint(id(RAW(i->condition)));
+            uint(id(RAW(i->then_part)));
+            uint(id(RAW(i->else_part)));
+        } else if (FunExpr *f = dynamic_cast<FunExpr *>(e)) {
+            params(f->params);
+            out.put(fun_expr_tag);
+            list(fields);
+            uint(id(RAW(f->body)));
+            fields.clear();
+        } else if (CallExpr *c = dynamic_cast<CallExpr *>(e)) {
+            out.put(call_expr_tag);
+            uint(id(RAW(c->to_be_called)));
+            list(c->actual_args);
+        } else
+            throw std::runtime_error("checkpoint: unknown expression " + e->to_string());
+    } else if (r.table == Ref::env) {
+        if (ExtendedEnv *x = dynamic_cast<ExtendedEnv *>((Env *)r.p)) {
+            uint64_t name = string(x->name);
+            out.put(extended_env_tag);
+            uint(name);
+            uint(id(RAW(x->val)));
+            uint(id(RAW(x->rest)));
+        } else if (CallEnv *x = dynamic_cast<CallEnv *>((Env *)r.p)) {
+            // the parameters, then a value for each, then the rest
+            params(x->params);
+            out.put(call_env_tag);
+            list(fields);
+            fields.clear();
+            for (size_t i = 0; i < x->params->names.size(); i++)
+                uint(id(RAW(x->val(i))));
+            uint(id(RAW(x->rest)));
+        } else if (ClosureEnv *x = dynamic_cast<ClosureEnv *>((Env *)r.p)) {
+            // each capture is a name and a value id plus one, or 0
+            for (const std::string &name : x->captures->names)
+                fields.push_back(string(name));
+            out.put(closure_env_tag);
+            uint(fields.size());
+            for (size_t i = 0; i < fields.size(); i++) {
+                uint(fields[i]);
+                uint(x->val(i) != nullptr ? id(RAW(x->val(i))) + 1 : 0);
+            }
+            fields.clear();
+        } else
+            out.put(empty_env_tag);
+    } else if (r.table == Ref::val) {
+        Val *v = (Val *)r.p;
+        if (NumVal *n = dynamic_cast<NumVal *>(v)) {
+            if (n->rep.is_small()) {
+                out.put(num_val_tag);
+                sint(n->rep.small_value());
+            } else {
+                uint64_t digits = string(n->rep.to_string());
+                out.put(big_num_val_tag);
+                uint(digits);
+            }
+        } else if (BoolVal *b = dynamic_cast<BoolVal *>(v)) {
+            out.put(bool_val_tag);
+            uint(b->rep);
+        } else if (FunVal *f = dynamic_cast<FunVal *>(v)) {
+            params(f->params);
+            out.put(fun_val_tag);
+            list(fields);
+            uint(id(RAW(f->body)));
+            uint(id(RAW(f->env)));
+            fields.clear();
+        } else
+            throw std::runtime_error("checkpoint: unknown value " + v->to_string());
+    } else {
+        Cont *c = (Cont *)r.p;
+        if (c == RAW(Cont::done))
+            out.put(done_cont_tag);
+        else if (MemoCont *k = dynamic_cast<MemoCont *>(c)) {
+            ids[r.p] = id(RAW(k->rest));    // left out: it's just its rest
+            return;
+        } else if (TraceEndCont *k = dynamic_cast<TraceEndCont *>(c)) {
+            ids[r.p] = id(RAW(k->rest));
+            return;
+        } else if (RightThenAddCont *k = dynamic_cast<RightThenAddCont *>(c)) {
+            out.put(right_then_add_cont_tag);
+            fields = {id(RAW(k->rhs)), id(RAW(k->env)), id(RAW(k->rest))};
+        } else if (AddCont *k = dynamic_cast<AddCont *>(c)) {
+            out.put(add_cont_tag);
+            fields = {id(RAW(k->lhs_val)), id(RAW(k->rest))};
+        } else if (RightThenMultCont *k = dynamic_cast<RightThenMultCont *>(c)) {
+            out.put(right_then_mult_cont_tag);
+            fields = {id(RAW(k->rhs)), id(RAW(k->env)), id(RAW(k->rest))};
+        } else if (MultCont *k = dynamic_cast<MultCont *>(c)) {
+            out.put(mult_cont_tag);
+            fields = {id(RAW(k->lhs_val)), id(RAW(k->rest))};
+        } else if (LetBodyCont *k = dynamic_cast<LetBodyCont *>(c)) {
+            uint64_t name = string(k->varStr);
+            out.put(let_body_cont_tag);
+            fields = {name, id(RAW(k->body)), id(RAW(k->env)), id(RAW(k->rest))};
+        } else if (IfBranchCont *k = dynamic_cast<IfBranchCont *>(c)) {
+            out.put(if_branch_cont_tag);
+            fields = {id(RAW(k->then_part)), id(RAW(k->else_part)), id(RAW(k->env)), id(RAW(k->rest))};
+        } else if (ArgThenCallCont *k = dynamic_cast<ArgThenCallCont *>(c)) {
+            out.put(arg_then_call_cont_tag);
+            list(k->actual_args);
+            fields = {id(RAW(k->env)), id(RAW(k->rest))};
+        } else if (CallCont *k = dynamic_cast<CallCont *>(c)) {
+            out.put(call_cont_tag);
+            uint(id(RAW(k->to_be_called_val)));
+            list(k->arg_vals);
+            list(k->actual_args);
+            fields = {id(RAW(k->env)), id(RAW(k->rest))};
+        } else if (RightThenCompCont *k = dynamic_cast<RightThenCompCont *>(c)) {
+            out.put(right_then_comp_cont_tag);
+            fields = {id(RAW(k->rhs)), id(RAW(k->env)), id(RAW(k->rest))};
+        } else if (CompCont *k = dynamic_cast<CompCont *>(c)) {
+            out.put(comp_cont_tag);
+            fields = {id(RAW(k->lhs_val)), id(RAW(k->rest))};
+        } else
+            throw std::runtime_error("checkpoint: unknown continuation");
+    }
+    for (uint64_t field : fields)
+        uint(field);
+    ids[r.p] = next_id++;
+}
+
+uint64_t CheckpointWriter::object(Ref root) {
+    // Iterative, since continuation and environment chains are as
+    // long as the recursion that built them
+    std::vector<std::pair<Ref, bool>> stack = {{root, false}};
+    while (!stack.empty()) {
+        Ref r = stack.back().first;
+        if (ids.count(r.p) != 0) {
+            stack.pop_back();
+            continue;
+        }
+        if (!stack.back().second) {
+            stack.back().second = true;
+            for (Ref child : children(r))
+                if (ids.count(child.p) == 0)
+                    stack.push_back({child, false});
+            continue;
+        }
+        stack.pop_back();
+        write(r);
+    }
+    return ids.at(root.p);
+}
+
+void save_checkpoint(StepState &state, std::ostream &out) {
+    CheckpointWriter writer(out);
+    out.write(magic, sizeof(magic) - 1);
+    // ids are written plus one, with 0 for a register that is empty
+    uint64_t expr = state.expr != nullptr ? writer.object(expr_ref(state.expr)) + 1 : 0;
+    uint64_t env = state.env != nullptr ? writer.object(env_ref(state.env)) + 1 : 0;
+    uint64_t val = state.val != nullptr ? writer.object(val_ref(state.val)) + 1 : 0;
+    uint64_t cont = writer.object(cont_ref(state.cont));
+    out.put(state_tag);
+    writer.uint(state.mode == Step::interp_mode ? 0 : 1);
+    writer.uint(expr);
+    writer.uint(env);
+    writer.uint(val);
+    writer.uint(cont);
+    writer.uint(state.steps);
+    if (!out)
+        throw std::runtime_error("checkpoint: can't write");
+}
+
+//==============================================================
+
+class CheckpointReader {
+public:
+    CheckpointReader(std::istream &_in) : in(_in) { }
+
+    StepState read();
+
+private:
+    std::istream &in;
+    std::vector<std::string> strings;
+    std::vector<PTR(Expr)> exprs;
+    std::vector<PTR(Env)> envs;
+    std::vector<PTR(Val)> vals;
+    std::vector<PTR(Cont)> conts;
+
+    // One object of each kind per id, where only one is set
+    PTR(Expr) expr() { return get(exprs, "expression"); }
+    PTR(Env) env() { return get(envs, "environment"); }
+    PTR(Val) val() { return get(vals, "value"); }
+    PTR(Cont) cont() { return get(conts, "continuation"); }
+    const std::string &string();
+    template <class T> T get(std::vector<T> &table, const char *what);
+    // A count and then that many ids from `table`
+    template <class T> std::vector<T> list(std::vector<T> &table, const char *what);
+    PTR(ParamList) params();
+    // A number too big for `sint`, as the id of its decimal string
+    Number big_number();
+    void add(PTR(Expr) e) { add(e, nullptr, nullptr, nullptr); }
+    void add(PTR(Env) e) { add(nullptr, e, nullptr, nullptr); }
+    void add(PTR(Val) v) { add(nullptr, nullptr, v, nullptr); }
+    void add(PTR(Cont) c) { add(nullptr, nullptr, nullptr, c); }
+    void add(PTR(Expr) x, PTR(Env) e, PTR(Val) v, PTR(Cont) c);
+    uint64_t uint();
+    int64_t sint();
+    int tag();
+    std::string chars(uint64_t length);
+};
+
+static std::runtime_error malformed(const std::string &why) {
+    return std::runtime_error("malformed checkpoint: " + why);
+}
+
+int CheckpointReader::tag() {
+    int c = in.get();
+    if (c == EOF)
+        throw malformed("unexpected end");
+    return c;
+}
+
+uint64_t CheckpointReader::uint() {
+    uint64_t n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = tag();
+        n |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return n;
+    }
+    throw malformed("number too long");
+}
+
+// `length` comes from the file, so the string only grows as its
+// characters are actually read, and a bad length can't make it
+// allocate more than the input holds
+std::string CheckpointReader::chars(uint64_t length) {
+    std::string s;
+    char chunk[4096];
+    while (length > 0) {
+        size_t n = (size_t)std::min<uint64_t>(length, sizeof(chunk));
+        if (!in.read(chunk, n))
+            throw malformed("unexpected end");
+        s.append(chunk, n);
+        length -= n;
+    }
+    return s;
+}
+
+int64_t CheckpointReader::sint() {
+    uint64_t n = uint();
+    return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+}
+
+const std::string &CheckpointReader::string() {
+    uint64_t id = uint();
+    if (id >= strings.size())
+        throw malformed("no string " + std::to_string(id));
+    return strings[id];
+}
+
+template <class T>
+T CheckpointReader::get(std::vector<T> &table, const char *what) {
+    uint64_t id = uint();
+    if (id >= table.size() || table[id] == nullptr)
+        throw malformed(std::to_string(id) + " isn't " + what);
+    return table[id];
+}
+
+template <class T>
+std::vector<T> CheckpointReader::list(std::vector<T> &table, const char *what) {
+    std::vector<T> items;
+    for (uint64_t n = uint(); n > 0; n--)
+        items.push_back(get(table, what));
+    return items;
+}
+
+PTR(ParamList) CheckpointReader::params() {
+    std::vector<std::string> names;
+    for (uint64_t n = uint(); n > 0; n--)
+        names.push_back(string());
+    if (names.empty())
+        throw malformed("no parameters");
+    return NEW(ParamList)(names);
+}
+
+Number CheckpointReader::big_number() {
+    std::string digits = string();
+    bool negative = !digits.empty() && digits[0] == '-';
+    if (negative)
+        digits.erase(0, 1);
+    if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos)
+        throw malformed("bad number " + digits);
+    return Number::parse(digits, negative);
+}
+
+void CheckpointReader::add(PTR(Expr) x, PTR(Env) e, PTR(Val) v, PTR(Cont) c) {
+    exprs.push_back(x);
+    envs.push_back(e);
+    vals.push_back(v);
+    conts.push_back(c);
+}
+
+StepState CheckpointReader::read() {
+    char header[sizeof(magic) - 1];
+    if (!in.read(header, sizeof(header)) || std::string(header, sizeof(header)) != magic)
+        throw malformed("not a checkpoint");
+
+    while (1) {
+        int t = tag();
+        switch (t) {
+            case string_tag:
+                strings.push_back(chars(uint()));
+                break;
+            case num_expr_tag: add(NEW(NumExpr)(sint())); break;
+            case big_num_expr_tag: add(NEW(NumExpr)(big_number())); break;
+            case bool_expr_tag: add(NEW(BoolExpr)(uint() != 0)); break;
+            case var_expr_tag: add(NEW(VarExpr)(string())); break;
+            case add_expr_tag: { PTR(Expr) l = expr(); add(NEW(AddExpr)(l, expr())); break; }
+            case mult_expr_tag: { PTR(Expr) l = expr(); add(NEW(MultExpr)(l, expr())); break; }
+            case compare_expr_tag: { PTR(Expr) l = expr(); add(NEW(CompareExpr)(l, expr())); break; }
+            case let_expr_tag: {
+                std::string name = string();
+                PTR(Expr) rhs = expr();
+                add(NEW(LetExpr)(name, rhs, expr()));
+                break;
+            }
+            case if_expr_tag: {
+                PTR(Expr) condition = expr();
+                PTR(Expr) then_part = expr();
+                add(NEW(IfExpr)(condition, then_part, expr()));
+                break;
+            }
+            case fun_expr_tag: { PTR(ParamList) ps = params(); add(NEW(FunExpr)(ps, expr())); break; }
+            case call_expr_tag: {
+                PTR(Expr) f = expr();
+                std::vector<PTR(Expr)> args = list(exprs, "expression");
+                if (args.empty())
+                    throw malformed("call without arguments");
+                add(NEW(CallExpr)(f, args));
+                break;
+            }
+            case empty_env_tag: add(Env::empty); break;
+            case extended_env_tag: {
+                std::string name = string();
+                PTR(Val) v = val();
+                add(NEW(ExtendedEnv)(env(), name, v));
+                break;
+            }
+            case call_env_tag: {
+                PTR(ParamList) ps = params();
+                std::vector<PTR(Val)> args;
+                for (size_t i = 0; i < ps->names.size(); i++)
+                    args.push_back(val());
+                add(NEW(CallEnv)(env(), ps, args.data()));
+                break;
+            }
+            case closure_env_tag: {
+                // in the order of their symbols here, which needn't be
+                // the order they were written in
+                std::vector<std::pair<int, PTR(Val)>> captured;
+                for (uint64_t n = uint(); n > 0; n--) {
+                    int sym = Symbol::intern(string());
+                    uint64_t v = uint();
+                    if (v != 0 && vals.at(v - 1) == nullptr)
+                        throw malformed(std::to_string(v - 1) + " isn't value");
+                    captured.push_back({sym, v == 0 ? nullptr : vals.at(v - 1)});
+                }
+                std::sort(captured.begin(), captured.end(),
+                          [](const std::pair<int, PTR(Val)> &a, const std::pair<int, PTR(Val)> &b) {
+                              return a.first < b.first;
+                          });
+                std::vector<int> syms;
+                std::vector<PTR(Val)> captured_vals;
+                for (auto const &capture : captured) {
+                    if (!syms.empty() && syms.back() == capture.first)
+                        throw malformed("variable captured twice");
+                    syms.push_back(capture.first);
+                    captured_vals.push_back(capture.second);
+                }
+                add(NEW(ClosureEnv)(NEW(CaptureList)(syms), captured_vals));
+                break;
+            }
+            case num_val_tag: add(NEW(NumVal)(sint())); break;
+            case big_num_val_tag: add(NEW(NumVal)(big_number())); break;
+            case bool_val_tag: add(NEW(BoolVal)(uint() != 0)); break;
+            case fun_val_tag: {
+                PTR(ParamList) ps = params();
+                PTR(Expr) body = expr();
+                add(NEW(FunVal)(ps, body, env()));
+                break;
+            }
+            case done_cont_tag: add(Cont::done); break;
+            case right_then_add_cont_tag: case right_then_mult_cont_tag:
+            case right_then_comp_cont_tag: {
+                PTR(Expr) e = expr();
+                PTR(Env) en = env();
+                PTR(Cont) rest = cont();
+                if (t == right_then_add_cont_tag)
+                    add(NEW(RightThenAddCont)(e, en, rest));
+                else if (t == right_then_mult_cont_tag)
+                    add(NEW(RightThenMultCont)(e, en, rest));
+                else
+                    add(NEW(RightThenCompCont)(e, en, rest));
+                break;
+            }
+            case arg_then_call_cont_tag: {
+                std::vector<PTR(Expr)> args = list(exprs, "expression");
+                if (args.empty())
+                    throw malformed("call without arguments");
+                PTR(Env) en = env();
+                add(NEW(ArgThenCallCont)(args, en, cont()));
+                break;
+            }
+            case call_cont_tag: {
+                PTR(Val) f = val();
+                std::vector<PTR(Val)> arg_vals = list(vals, "value");
+                std::vector<PTR(Expr)> args = list(exprs, "expression");
+                if (arg_vals.size() >= args.size())
+                    throw malformed("no argument left to call with");
+                PTR(Env) en = env();
+                add(NEW(CallCont)(f, arg_vals, args, en, cont()));
+                break;
+            }
+            case add_cont_tag: case mult_cont_tag: case comp_cont_tag: {
+                PTR(Val) v = val();
+                PTR(Cont) rest = cont();
+                if (t == add_cont_tag)
+                    add(NEW(AddCont)(v, rest));
+                else if (t == mult_cont_tag)
+                    add(NEW(MultCont)(v, rest));
+                else
+                    add(NEW(CompCont)(v, rest));
+                break;
+            }
+            case let_body_cont_tag: {
+                std::string name = string();
+                PTR(Expr) body = expr();
+                PTR(Env) en = env();
+                add(NEW(LetBodyCont)(name, Symbol::intern(name), body, en, cont()));
+                break;
+            }
+            case if_branch_cont_tag: {
+                PTR(Expr) then_part = expr();
+                PTR(Expr) else_part = expr();
+                PTR(Env) en = env();
+                add(NEW(IfBranchCont)(then_part, else_part, en, cont()));
+                break;
+            }
+            case state_tag: {
+                StepState state;
+                state.mode = uint() == 0 ? Step::interp_mode : Step::continue_mode;
+                // registers that may be empty are stored plus one
+                uint64_t e = uint();
+                state.expr = e == 0 ? nullptr : exprs.at(e - 1);
+                e = uint();
+                state.env = e == 0 ? nullptr : envs.at(e - 1);
+                e = uint();
+                state.val = e == 0 ? nullptr : vals.at(e - 1);
+                state.cont = cont();
+                state.steps = (long)uint();
+                if (state.mode == Step::interp_mode && (state.expr == nullptr || state.env == nullptr))
+                    throw malformed("nothing to interpret");
+                if (state.mode == Step::continue_mode && state.val == nullptr)
+                    throw malformed("no value to continue with");
+                return state;
+            }
+            default:
+                throw malformed("unknown record " + std::to_string(t));
+        }
+    }
+}
+
+StepState load_checkpoint(std::istream &in) {
+    // whatever a bad file makes decoding throw is reported the same
+    // way as what it checks for
+    try {
+        return CheckpointReader(in).read();
+    } catch (std::out_of_range &) {
+        throw malformed("bad reference");
+    } catch (std::logic_error &ex) {
+        throw malformed(ex.what());
+    } catch (std::bad_alloc &) {
+        throw malformed("too large");
+    }
+}
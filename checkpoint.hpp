@@ -0,0 +1,20 @@
+#ifndef checkpoint_hpp
+#define checkpoint_hpp
+
+#include <iostream>
+
+class StepState;
+
+// Writes a suspended Step machine as a compact binary checkpoint:
+// the parts of the program it still has to run, and its
+// environments, values and continuations, with sharing preserved so
+// that restoring doesn't copy anything twice. Memoization and trace
+// continuations are left out, since their keys and spans only mean
+// something in the process that made them.
+void save_checkpoint(StepState &state, std::ostream &out);
+
+// Reads a checkpoint written by save_checkpoint, which can then be
+// resumed with Step::run. Throws `runtime_error` if it's malformed.
+StepState load_checkpoint(std::istream &in);
+
+#endif /* checkpoint_hpp */
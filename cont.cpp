@@ -10,6 +10,8 @@
 #include "step.hpp"
 #include "value.hpp"
 #include "env.hpp"
+#include "memo.hpp"
+#include "trace.hpp"
 
 PTR(Cont) Cont::done = NEW(DoneCont)();
 
@@ -32,12 +34,12 @@ RightThenAddCont::RightThenAddCont(PTR(Expr) _rhs, PTR(Env) _env, PTR(Cont) _res
 }
 
 void RightThenAddCont::step_continue() {
-    PTR(Val) lhs_val = Step::val;
+    PTR(Val) lhs_val = Step::machine->val;
     
-    Step::mode = Step::interp_mode;
-    Step::expr = rhs;
-    Step::env = Step::env;
-    Step::cont = NEW(AddCont)(lhs_val, rest);
+    Step::machine->mode = Step::interp_mode;
+    Step::machine->expr = rhs;
+    Step::machine->env = env;
+    Step::machine->cont = NEW(AddCont)(lhs_val, rest);
 }
 
 //==============================================================
@@ -48,11 +50,11 @@ AddCont::AddCont(PTR(Val) _lhs_val, PTR(Cont) _rest) {
 }
 
 void AddCont::step_continue() {
-    PTR(Val) rhs_val = Step::val;
+    PTR(Val) rhs_val = Step::machine->val;
     
-    Step::mode = Step::continue_mode;
-    Step::val = lhs_val -> add_to(rhs_val);
-    Step::cont = rest;
+    Step::machine->mode = Step::continue_mode;
+    Step::machine->val = lhs_val -> add_to(rhs_val);
+    Step::machine->cont = rest;
 }
 
 //==============================================================
@@ -66,12 +68,12 @@ RightThenMultCont::RightThenMultCont(PTR(Expr) _rhs, PTR(Env) _env, PTR(Cont) _r
 }
 
 void RightThenMultCont::step_continue() {
-    PTR(Val) lhs_val = Step::val;
+    PTR(Val) lhs_val = Step::machine->val;
     
-    Step::mode = Step::interp_mode;
-    Step::expr = rhs;
-    Step::env = Step::env;
-    Step::cont = NEW(MultCont)(lhs_val, rest);
+    Step::machine->mode = Step::interp_mode;
+    Step::machine->expr = rhs;
+    Step::machine->env = env;
+    Step::machine->cont = NEW(MultCont)(lhs_val, rest);
 }
 
 
@@ -83,29 +85,34 @@ MultCont::MultCont(PTR(Val) _lhs_val, PTR(Cont) _rest) {
 }
 
 void MultCont::step_continue() {
-    PTR(Val) rhs_val = Step::val;
+    PTR(Val) rhs_val = Step::machine->val;
     
-    Step::mode = Step::continue_mode;
-    Step::val = lhs_val -> mult_with(rhs_val);
-    Step::cont = rest;
+    Step::machine->mode = Step::continue_mode;
+    Step::machine->val = lhs_val -> mult_with(rhs_val);
+    Step::machine->cont = rest;
 }
 
 
 //==============================================================
 
-LetBodyCont::LetBodyCont(std::string _varStr, PTR(Expr) _body, PTR(Env) _env, PTR(Cont) _rest) {
+LetBodyCont::LetBodyCont(std::string _varStr, int _var_sym, PTR(Expr) _body, PTR(Env) _env, PTR(Cont) _rest) {
     varStr = _varStr;
+    var_sym = _var_sym;
     body = _body;
     env = _env;
     rest = _rest;
 }
 
 void LetBodyCont::step_continue() {
-    Step::mode = Step::interp_mode;
-    Step::expr = body;
-    Step::env = NEW(ExtendedEnv)(env, varStr, Step::val);
+    Step::machine->mode = Step::interp_mode;
+    Step::machine->expr = body;
+    Step::machine->env = NEW(ExtendedEnv)(env, varStr, var_sym, Step::machine->val);
     
-    Step::cont = rest;
+    if (Trace::enabled) {
+        Trace::begin_let(var_sym, body);
+        Step::machine->cont = NEW(TraceEndCont)(rest);
+    } else
+        Step::machine->cont = rest;
 }
 
 //==============================================================
@@ -119,32 +126,33 @@ IfBranchCont::IfBranchCont(PTR(Expr) _then_part, PTR(Expr) _else_part, PTR(Env)
 
 
 void IfBranchCont::step_continue() {
-    PTR(Val) condition_val = Step::val;
-    Step::mode = Step::interp_mode;
+    PTR(Val) condition_val = Step::machine->val;
+    Step::machine->mode = Step::interp_mode;
     if (condition_val -> is_true()) {
-        Step::expr = then_part;
+        Step::machine->expr = then_part;
     } else {
-        Step::expr = else_part;
+        Step::machine->expr = else_part;
     }
-    Step::env = env;
-    Step::cont = rest;
+    Step::machine->env = env;
+    Step::machine->cont = rest;
 }
 
 //==============================================================
 
 
-ArgThenCallCont::ArgThenCallCont(PTR(Expr) _actual_arg, PTR(Env) _env, PTR(Cont) _rest) {
-    actual_arg = _actual_arg;
+ArgThenCallCont::ArgThenCallCont(std::vector<PTR(Expr)> _actual_args, PTR(Env) _env, PTR(Cont) _rest) {
+    actual_args = _actual_args;
     env = _env;
     rest = _rest;
 }
 
 void ArgThenCallCont::step_continue() {
-    Step::mode = Step::interp_mode;
-    Step::expr = actual_arg;
-    Step::env = env;
+    Step::machine->mode = Step::interp_mode;
+    Step::machine->expr = actual_args[0];
+    Step::machine->env = env;
     
-    Step::cont = NEW(CallCont)(Step::val, rest);
+    Step::machine->cont = NEW(CallCont)(Step::machine->val, std::vector<PTR(Val)>(),
+                                        actual_args, env, rest);
 }
 
 
@@ -152,14 +160,26 @@ void ArgThenCallCont::step_continue() {
 
 
 
-CallCont::CallCont(PTR(Val) _to_be_called_val, PTR(Cont) _rest) {
+CallCont::CallCont(PTR(Val) _to_be_called_val, std::vector<PTR(Val)> _arg_vals,
+                   std::vector<PTR(Expr)> _actual_args, PTR(Env) _env, PTR(Cont) _rest) {
     to_be_called_val = _to_be_called_val;
+    arg_vals = _arg_vals;
+    actual_args = _actual_args;
+    env = _env;
     rest = _rest;
 }
 
 void CallCont::step_continue() {
-    to_be_called_val -> call_step(Step::val, rest);
-    
+    std::vector<PTR(Val)> vals = arg_vals;
+    vals.push_back(Step::machine->val);
+    if (vals.size() == actual_args.size()) {
+        to_be_called_val -> call_step(vals, rest);
+        return;
+    }
+    Step::machine->mode = Step::interp_mode;
+    Step::machine->expr = actual_args[vals.size()];
+    Step::machine->env = env;
+    Step::machine->cont = NEW(CallCont)(to_be_called_val, vals, actual_args, env, rest);
 }
 
 //==============================================================
@@ -172,12 +192,12 @@ RightThenCompCont::RightThenCompCont(PTR(Expr) _rhs, PTR(Env) _env, PTR(Cont) _r
 
 
 void RightThenCompCont::step_continue() {
-    PTR(Val) lhs_val = Step::val;
-    Step::mode = Step::interp_mode;
-    Step::expr = rhs;
-    Step::env = env;
+    PTR(Val) lhs_val = Step::machine->val;
+    Step::machine->mode = Step::interp_mode;
+    Step::machine->expr = rhs;
+    Step::machine->env = env;
     
-    Step::cont = NEW(CompCont)(lhs_val, rest);
+    Step::machine->cont = NEW(CompCont)(lhs_val, rest);
 }
 
 //==============================================================
@@ -189,16 +209,39 @@ CompCont::CompCont(PTR(Val) _lhs_val, PTR(Cont) _rest) {
 
 
 void CompCont::step_continue() {
-    PTR(Val) rhs_val = Step::val;
+    PTR(Val) rhs_val = Step::machine->val;
     
-    Step::mode = Step::continue_mode;
+    Step::machine->mode = Step::continue_mode;
     if (lhs_val -> equals(rhs_val)) {
-        Step::val = NEW(BoolVal)(true);
+        Step::machine->val = NEW(BoolVal)(true);
     } else {
-        Step::val = NEW(BoolVal)(false);
+        Step::machine->val = NEW(BoolVal)(false);
     }
     
-    Step::cont = rest;
+    Step::machine->cont = rest;
     
 }
 
+//==============================================================
+
+MemoCont::MemoCont(uint64_t _serial, std::vector<PTR(Val)> _actual_arg_vals, PTR(Cont) _rest) {
+    serial = _serial;
+    actual_arg_vals = _actual_arg_vals;
+    rest = _rest;
+}
+
+void MemoCont::step_continue() {
+    Memo::remember(serial, actual_arg_vals.data(), actual_arg_vals.size(), Step::machine->val);
+    Step::machine->cont = rest;
+}
+
+//==============================================================
+
+TraceEndCont::TraceEndCont(PTR(Cont) _rest) {
+    rest = _rest;
+}
+
+void TraceEndCont::step_continue() {
+    Trace::end();
+    Step::machine->cont = rest;
+}
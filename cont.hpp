@@ -10,6 +10,8 @@
 #define cont_hpp
 
 #include <stdio.h>
+#include <stdint.h>
+#include <vector>
 #include "pointer.hpp"
 #include "expr.hpp"
 
@@ -18,7 +20,7 @@ class Expr;
 class Env;
 class Val;
 
-class Cont {
+class Cont REF_COUNTED {
 public:
     static PTR(Cont) done;
     
@@ -78,11 +80,12 @@ public:
 class LetBodyCont : public Cont {
 public:
     std::string varStr;
+    int var_sym;
     PTR(Expr) body;
     PTR(Env) env;
     PTR(Cont) rest;
     
-    LetBodyCont(std::string varStr, PTR(Expr) body, PTR(Env) env, PTR(Cont) res);
+    LetBodyCont(std::string varStr, int var_sym, PTR(Expr) body, PTR(Env) env, PTR(Cont) res);
     void step_continue();
 };
 
@@ -102,21 +105,27 @@ public:
 
 class ArgThenCallCont : public Cont {
 public:
-    PTR(Expr) actual_arg;
+    std::vector<PTR(Expr)> actual_args;
     PTR(Env) env;
     PTR(Cont) rest;
     
-    ArgThenCallCont(PTR(Expr) actual_arg, PTR(Env) env, PTR(Cont) rest);
+    ArgThenCallCont(std::vector<PTR(Expr)> actual_args, PTR(Env) env, PTR(Cont) rest);
     void step_continue();
 };
 
 
+// Waits for the value of `actual_args[arg_vals.size()]`, then
+// evaluates the next argument or, after the last one, makes the call
 class CallCont : public Cont {
 public:
     PTR(Val) to_be_called_val;
+    std::vector<PTR(Val)> arg_vals;
+    std::vector<PTR(Expr)> actual_args;
+    PTR(Env) env;
     PTR(Cont) rest;
     
-    CallCont(PTR(Val) to_be_called_val, PTR(Cont) rest);
+    CallCont(PTR(Val) to_be_called_val, std::vector<PTR(Val)> arg_vals,
+             std::vector<PTR(Expr)> actual_args, PTR(Env) env, PTR(Cont) rest);
     void step_continue();
 };
 
@@ -140,4 +149,24 @@ public:
     CompCont(PTR(Val) lhs_val, PTR(Cont) rest);
     void step_continue();
 };
+
+// Records the result of a memoized call before continuing
+class MemoCont : public Cont {
+public:
+    uint64_t serial;
+    std::vector<PTR(Val)> actual_arg_vals;
+    PTR(Cont) rest;
+
+    MemoCont(uint64_t serial, std::vector<PTR(Val)> actual_arg_vals, PTR(Cont) rest);
+    void step_continue();
+};
+
+// Ends the innermost span of the Trace before continuing
+class TraceEndCont : public Cont {
+public:
+    PTR(Cont) rest;
+
+    TraceEndCont(PTR(Cont) rest);
+    void step_continue();
+};
 #endif /* cont_hpp */
@@ -0,0 +1,206 @@
+#include "cse.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "expr.hpp"
+#include "symbol.hpp"
+
+// One arithmetic or comparison node found while scanning a scope,
+// together with its structural hash, its size in nodes, the part of
+// the scope it is in (see `cse_scope`), and whether everything the
+// scope evaluates before it is pure.
+struct Occurrence {
+    size_t hash;
+    int size;
+    PTR(Expr) expr;
+    size_t part;
+    bool after_pure;
+};
+
+static size_t combine(size_t seed, size_t h) {
+    return seed ^ (h + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// Calls `same` on every child of `e` that is evaluated in the same
+// environment as `e` and unconditionally whenever `e` is, and
+// `nested` on every other child (`_let` and `_fun` bodies, which see
+// an extra binding, and `_if` branches, which may not run at all),
+// then rebuilds `e` from the results.
+template<typename Same, typename Nested>
+static PTR(Expr) rebuild(PTR(Expr) e, Same same, Nested nested) {
+    if (PTR(AddExpr) a = CAST(AddExpr)(e))
+        return NEW(AddExpr)(same(a->lhs), same(a->rhs));
+    if (PTR(MultExpr) m = CAST(MultExpr)(e))
+        return NEW(MultExpr)(same(m->lhs), same(m->rhs));
+    if (PTR(CompareExpr) c = CAST(CompareExpr)(e))
+        return NEW(CompareExpr)(same(c->lhs), same(c->rhs));
+    if (PTR(CallExpr) c = CAST(CallExpr)(e)) {
+        PTR(Expr) to_be_called = same(c->to_be_called);
+        std::vector<PTR(Expr)> actual_args;
+        for (PTR(Expr) const &arg : c->actual_args)
+            actual_args.push_back(same(arg));
+        return NEW(CallExpr)(to_be_called, actual_args);
+    }
+    if (PTR(LetExpr) l = CAST(LetExpr)(e))
+        return NEW(LetExpr)(l->varStr, l->var_sym, same(l->rhs), nested(l->body));
+    if (PTR(IfExpr) i = CAST(IfExpr)(e))
+        return NEW(IfExpr)(same(i->condition), nested(i->then_part), nested(i->else_part));
+    if (PTR(FunExpr) f = CAST(FunExpr)(e))
+        return NEW(FunExpr)(f->params, nested(f->body));
+    return e;
+}
+
+// Scans the part of `e` that belongs to the current scope, in the
+// order it is evaluated, appending every arithmetic or comparison
+// node built only from literals, variables and other such nodes to
+// `occs`. Those are the candidates: they can't diverge, but unless
+// they are pure they can fail, as `x + 1` does when `x` is a boolean.
+// `pure_so_far` says whether everything evaluated before `e` is pure,
+// and is updated to include `e`. Returns whether `e` itself has the
+// shape of a candidate.
+static bool collect(PTR(Expr) e, std::vector<Occurrence> &occs, size_t &hash, bool &pure_so_far) {
+    bool after_pure = pure_so_far;
+    bool candidate = false;
+    size_t tag = 0;
+    PTR(Expr) lhs = nullptr;
+    PTR(Expr) rhs = nullptr;
+    if (PTR(NumExpr) n = CAST(NumExpr)(e)) {
+        hash = combine(1, n->rep.hash());
+        candidate = true;
+    } else if (PTR(BoolExpr) b = CAST(BoolExpr)(e)) {
+        hash = combine(2, b->rep);
+        candidate = true;
+    } else if (PTR(VarExpr) v = CAST(VarExpr)(e)) {
+        hash = combine(3, v->sym);
+        candidate = true;
+    } else if (PTR(AddExpr) a = CAST(AddExpr)(e)) {
+        tag = 4; lhs = a->lhs; rhs = a->rhs;
+    } else if (PTR(MultExpr) m = CAST(MultExpr)(e)) {
+        tag = 5; lhs = m->lhs; rhs = m->rhs;
+    } else if (PTR(CompareExpr) c = CAST(CompareExpr)(e)) {
+        tag = 6; lhs = c->lhs; rhs = c->rhs;
+    }
+
+    if (lhs != nullptr) {
+        size_t lhs_hash, rhs_hash;
+        bool lhs_ok = collect(lhs, occs, lhs_hash, pure_so_far);
+        bool rhs_ok = collect(rhs, occs, rhs_hash, pure_so_far);
+        if (lhs_ok && rhs_ok) {
+            hash = combine(combine(tag, lhs_hash), rhs_hash);
+            occs.push_back({hash, e->size, e, 0, after_pure});
+            candidate = true;
+        }
+    } else if (CAST(LetExpr)(e) != nullptr || CAST(IfExpr)(e) != nullptr || CAST(CallExpr)(e) != nullptr) {
+        // Not a candidate itself, but the parts evaluated in this
+        // scope may still contain some.
+        size_t ignored_hash;
+        auto scan = [&](PTR(Expr) child) {
+            collect(child, occs, ignored_hash, pure_so_far);
+            return child;
+        };
+        auto skip = [](PTR(Expr) child) { return child; };
+        (void)rebuild(e, scan, skip);
+    }
+
+    pure_so_far = after_pure && e->pure;
+    return candidate;
+}
+
+// Returns the first occurrence of the largest candidate that occurs
+// at least twice and can be evaluated ahead of everything before it
+// without changing which error, if any, is reported: because it is
+// pure, or because all of that is. Returns nullptr if there is none.
+static const Occurrence *largest_repeat(const std::vector<Occurrence> &occs) {
+    struct Group {
+        const Occurrence *first;
+        int count;
+    };
+    std::unordered_map<size_t, std::vector<Group>> groups;
+
+    const Occurrence *best = nullptr;
+    for (const Occurrence &occ : occs) {
+        std::vector<Group> &bucket = groups[occ.hash];
+        Group *group = nullptr;
+        for (Group &g : bucket) {
+            if (g.first->size == occ.size && g.first->expr->equals(occ.expr)) {
+                group = &g;
+                break;
+            }
+        }
+        if (group == nullptr) {
+            bucket.push_back({&occ, 0});
+            group = &bucket.back();
+        }
+        group->count++;
+        const Occurrence *first = group->first;
+        if (group->count == 2 && (first->after_pure || first->expr->pure)
+            && (best == nullptr || first->size > best->size))
+            best = first;
+    }
+    return best;
+}
+
+static PTR(Expr) replace(PTR(Expr) e, PTR(Expr) target, std::string name) {
+    if (e->size < target->size)
+        return e;
+    if (e->size == target->size && e->equals(target))
+        return NEW(VarExpr)(name);
+    return rebuild(e,
+                   [&](PTR(Expr) child) { return replace(child, target, name); },
+                   [](PTR(Expr) child) { return child; });
+}
+
+static PTR(Expr) cse_scope(PTR(Expr) e);
+
+// Runs `cse_scope` on every nested scope reachable from `e` without
+// leaving the current one.
+static PTR(Expr) cse_nested(PTR(Expr) e) {
+    return rebuild(e,
+                   [&](PTR(Expr) child) { return cse_nested(child); },
+                   [&](PTR(Expr) child) { return cse_scope(child); });
+}
+
+static PTR(Expr) cse_scope(PTR(Expr) e) {
+    // The scope as it is evaluated: the right-hand sides of the
+    // bindings introduced so far, in order, and then `e`
+    std::vector<std::string> names;
+    std::vector<PTR(Expr)> parts = {e};
+
+    while (1) {
+        std::vector<Occurrence> occs;
+        bool pure_so_far = true;
+        for (size_t i = 0; i < parts.size(); i++) {
+            size_t start = occs.size();
+            size_t hash;
+            collect(parts[i], occs, hash, pure_so_far);
+            for (size_t j = start; j < occs.size(); j++)
+                occs[j].part = i;
+        }
+
+        const Occurrence *repeated = largest_repeat(occs);
+        if (repeated == nullptr)
+            break;
+
+        // Bound just before the part where it is first evaluated, so
+        // it runs no earlier than `largest_repeat` allowed, and after
+        // the bindings of any names it uses
+        PTR(Expr) target = repeated->expr;
+        size_t at = repeated->part;
+        std::string name = Symbol::fresh("cse");
+        for (size_t i = 0; i < parts.size(); i++)
+            parts[i] = replace(parts[i], target, name);
+        names.insert(names.begin() + at, name);
+        parts.insert(parts.begin() + at, target);
+    }
+
+    e = cse_nested(parts.back());
+    for (size_t i = names.size(); i-- > 0; )
+        e = NEW(LetExpr)(names[i], parts[i], e);
+    return e;
+}
+
+PTR(Expr) eliminate_common_subexprs(PTR(Expr) e) {
+    return cse_scope(e);
+}
@@ -0,0 +1,14 @@
+#ifndef cse_hpp
+#define cse_hpp
+
+#include "pointer.hpp"
+
+class Expr;
+
+// Common subexpression elimination: finds arithmetic and comparison
+// subexpressions that appear more than once in the same scope, binds
+// each one to a fresh variable with a `_let` and replaces the copies
+// with references to it, so each is evaluated only once.
+PTR(Expr) eliminate_common_subexprs(PTR(Expr) e);
+
+#endif /* cse_hpp */
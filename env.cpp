@@ -7,8 +7,12 @@
 //
 
 #include "env.hpp"
+
+#include <algorithm>
+
 #include "expr.hpp"
 #include "value.hpp"
+#include "symbol.hpp"
 
 PTR(Env) Env::empty = NEW(EmptyEnv)();
 
@@ -18,33 +22,184 @@ EmptyEnv::EmptyEnv() {
     
 }
 
-PTR(Val) EmptyEnv::lookup(std::string find_name) {
-    throw std::runtime_error("free variable: " + find_name);
+PTR(Val) EmptyEnv::find(const std::string &find_name) {
+    return nullptr;
+}
+
+PTR(Val) Env::lookup(const std::string &find_name) {
+    PTR(Val) val = find(find_name);
+    if (val == nullptr)
+        throw std::runtime_error("free variable: " + find_name);
+    return val;
+}
+
+PTR(Val) Env::lookup(const std::string &find_name, int sym, std::atomic<int> &hint) {
+    PTR(Val) val = find_sym(sym, hint);
+    if (val == nullptr)
+        throw std::runtime_error("free variable: " + find_name);
+    return val;
+}
+
+PTR(Val) Env::find_sym(int sym, std::atomic<int> &hint) {
+    uint64_t bit = (uint64_t)1 << (sym & 63);
+    int depth = hint.load(std::memory_order_relaxed);
+    if (depth >= 0 && depth < frames && !(shadowed & bit)) {
+        // `frames` says these are all FrameEnvs
+        FrameEnv *frame = static_cast<FrameEnv *>(this);
+        for (int i = 0; i < depth; i++)
+            frame = static_cast<FrameEnv *>(RAW(frame->rest));
+        if (PTR(Val) *slot = frame->slot(sym))
+            return *slot;
+    }
+
+    Env *env = this;
+    for (depth = 0; depth < frames; depth++) {
+        FrameEnv *frame = static_cast<FrameEnv *>(env);
+        if (PTR(Val) *slot = frame->slot(sym)) {
+            hint.store(depth, std::memory_order_relaxed);
+            return *slot;
+        }
+        env = RAW(frame->rest);
+    }
+    return env->find_captured(sym, hint);
+}
+
+PTR(Val) Env::find_captured(int sym, std::atomic<int> &hint) {
+    return nullptr;
 }
 
+//============================================================
 
+FrameEnv::FrameEnv(PTR(Env) _rest, bool _call)
+    : rest(_rest), call(_call) {
+    frames = rest->frames + 1;
+    bound = rest->bound;
+    shadowed = rest->shadowed;
+}
+
+void FrameEnv::bind(int sym) {
+    uint64_t bit = (uint64_t)1 << (sym & 63);
+    shadowed |= bound & bit;
+    bound |= bit;
+}
+
+PTR(Val) *FrameEnv::slot(int sym) {
+    if (!call) {
+        ExtendedEnv *x = static_cast<ExtendedEnv *>(this);
+        return x->sym == sym ? &x->val : nullptr;
+    }
+    CallEnv *c = static_cast<CallEnv *>(this);
+    const std::vector<int> &syms = c->params->syms;
+    for (size_t i = 0; i < syms.size(); i++)
+        if (syms[i] == sym)
+            return &c->val(i);
+    return nullptr;
+}
 
 //============================================================
 
-ExtendedEnv::ExtendedEnv(PTR(Env) _rest, std::string _name, PTR(Val) _val) {
-    rest = _rest;
+ExtendedEnv::ExtendedEnv(PTR(Env) _rest, std::string _name, PTR(Val) _val)
+    : ExtendedEnv(_rest, _name, Symbol::intern(_name), _val) {
+}
+
+ExtendedEnv::ExtendedEnv(PTR(Env) _rest, std::string _name, int _sym, PTR(Val) _val)
+    : FrameEnv(_rest, false) {
     name = _name;
+    sym = _sym;
     val = _val;
-    
+    bind(sym);
 }
 
 
-PTR(Val) ExtendedEnv::lookup(std::string find_name) {
+PTR(Val) ExtendedEnv::find(const std::string &find_name) {
     if (find_name == name) {
         return val;
     }
-    else {
-        PTR(ExtendedEnv) ext_env = CAST(ExtendedEnv)(rest);
-        
-        if (ext_env == NULL) {
-            throw std::runtime_error("free variable: " + find_name);
-        }
-        else return rest->lookup(find_name);
+    else return rest->find(find_name);
+}
+
+//============================================================
+
+CallEnv::CallEnv(PTR(Env) _rest, PTR(ParamList) _params, PTR(Val) const *vals)
+    : FrameEnv(_rest, true), params(_params) {
+    for (size_t i = 0; i < params->syms.size(); i++) {
+        if (i < inline_count)
+            first[i] = vals[i];
+        else
+            more.push_back(vals[i]);
+        bind(params->syms[i]);
+    }
+}
+
+PTR(Val) CallEnv::find(const std::string &find_name) {
+    const std::vector<std::string> &names = params->names;
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == find_name)
+            return val(i);
+    return rest->find(find_name);
+}
+
+//============================================================
+
+CaptureList::CaptureList(std::vector<int> _syms) {
+    syms = _syms;
+    for (int sym : syms)
+        names.push_back(Symbol::name(sym));
+}
+
+int CaptureList::index(int sym) {
+    auto found = std::lower_bound(syms.begin(), syms.end(), sym);
+    if (found == syms.end() || *found != sym)
+        return -1;
+    return (int)(found - syms.begin());
+}
+
+//============================================================
+
+ClosureEnv::ClosureEnv(PTR(CaptureList) _captures, PTR(Env) env) {
+    captures = _captures;
+    for (size_t i = 0; i < captures->syms.size(); i++) {
+        // there's no place to remember where each one was found
+        std::atomic<int> hint(-1);
+        set(i, env->find_sym(captures->syms[i], hint));
     }
 }
 
+ClosureEnv::ClosureEnv(PTR(CaptureList) _captures, std::vector<PTR(Val)> vals) {
+    captures = _captures;
+    for (size_t i = 0; i < vals.size(); i++)
+        set(i, vals[i]);
+}
+
+void ClosureEnv::set(size_t i, PTR(Val) val) {
+    if (i < inline_count)
+        first[i] = val;
+    else
+        more.push_back(val);
+}
+
+PTR(Val) ClosureEnv::find(const std::string &find_name) {
+    const std::vector<std::string> &names = captures->names;
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == find_name)
+            return val(i);
+    return nullptr;
+}
+
+PTR(Val) ClosureEnv::find_captured(int sym, std::atomic<int> &hint) {
+    int i = -2 - hint.load(std::memory_order_relaxed);
+    if (i < 0 || (size_t)i >= captures->syms.size() || captures->syms[i] != sym) {
+        i = captures->index(sym);
+        if (i < 0)
+            return nullptr;
+        hint.store(-2 - i, std::memory_order_relaxed);
+    }
+    return val(i);
+}
+
+PTR(Env) ClosureEnv::capture(PTR(CaptureList) captures, PTR(Env) env) {
+    // a closed `_fun` needs nothing
+    if (captures->syms.empty())
+        return Env::empty;
+    return NEW(ClosureEnv)(captures, env);
+}
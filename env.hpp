@@ -9,33 +9,150 @@
 #ifndef env_hpp
 #define env_hpp
 
+#include <stdint.h>
 #include <stdio.h>
+#include <atomic>
 #include <string>
+#include <vector>
 
 #include "pointer.hpp"
 
 class Val;
+class ParamList;
 
 class Env ENABLE_THIS(Env){
 public:
     static PTR(Env) empty;
-    virtual PTR(Val) lookup(std::string find_name) = 0;
+    // Throws `runtime_error` if `find_name` isn't bound
+    PTR(Val) lookup(const std::string &find_name);
+    // The same for `find_name`, whose symbol is `sym`. `hint` says
+    // where a lookup from the same place found it last time, which is
+    // checked first and updated to where it's found: the frame `hint`
+    // frames in when it's at least 0, or capture -2 - `hint` of the
+    // closure environment past the frames when it's below -1.
+    PTR(Val) lookup(const std::string &find_name, int sym, std::atomic<int> &hint);
+    // Returns nullptr if `find_name` isn't bound
+    virtual PTR(Val) find(const std::string &find_name) = 0;
+    // Returns nullptr if `sym` isn't bound, with `hint` as for `lookup`
+    PTR(Val) find_sym(int sym, std::atomic<int> &hint);
+
+    // How many frames (see FrameEnv) start this environment, and, by
+    // each symbol modulo 64, which symbols they bind and which they
+    // bind more than once. Where a symbol isn't bound twice, the frame
+    // with that symbol is the binding however far in it is.
+    int frames = 0;
+    uint64_t bound = 0;
+    uint64_t shadowed = 0;
+
+protected:
+    // Does the work of `find_sym` in an environment with no frames,
+    // which binds nothing unless it's a closure's
+    virtual PTR(Val) find_captured(int sym, std::atomic<int> &hint);
 };
 
 class EmptyEnv : public Env {
 public:
     EmptyEnv();
-    PTR(Val) lookup(std::string find_name);
+    PTR(Val) find(const std::string &find_name);
 };
 
-class ExtendedEnv : public Env {
+// An environment that binds variables in front of `rest`: an
+// ExtendedEnv, binding one, or a CallEnv, binding all of a call's
+// parameters. Env::lookup walks frames without virtual calls.
+class FrameEnv : public Env {
+public:
+    PTR(Env) rest;
+
+    // Where this frame itself binds `sym`, or nullptr if it doesn't
+    PTR(Val) *slot(int sym);
+
+protected:
+    // whether this is a CallEnv
+    const bool call;
+
+    FrameEnv(PTR(Env) rest, bool call);
+    // Adds `sym`, bound after the variables before it, to `bound` and
+    // `shadowed`
+    void bind(int sym);
+};
+
+class ExtendedEnv : public FrameEnv {
 public:
     std::string name;
+    int sym;
     PTR(Val) val;
-    PTR(Env) rest;
     
     ExtendedEnv(PTR(Env) rest, std::string name, PTR(Val) val);
-    PTR(Val) lookup(std::string find_name);
+    ExtendedEnv(PTR(Env) rest, std::string name, int sym, PTR(Val) val);
+    PTR(Val) find(const std::string &find_name);
+};
+
+// The frame of one call, binding all of the parameters at once, so
+// that a call costs one frame however many arguments it has
+class CallEnv : public FrameEnv {
+public:
+    PTR(ParamList) params;
+
+    // Binds `params` to the values at `vals`, one per parameter
+    CallEnv(PTR(Env) rest, PTR(ParamList) params, PTR(Val) const *vals);
+    PTR(Val) find(const std::string &find_name);
+
+    // The value of parameter `i`
+    PTR(Val) &val(size_t i) { return i < inline_count ? first[i] : more[i - inline_count]; }
+
+private:
+    // most functions take only a few parameters, which then take no
+    // allocation besides the frame's own
+    static const size_t inline_count = 3;
+    PTR(Val) first[inline_count];
+    std::vector<PTR(Val)> more;
+};
+
+// The variables a `_fun` captures, which are its free variables, in
+// increasing order of symbol, so that a captured variable's index is
+// found from its symbol by binary search. Every closure made from the
+// `_fun` shares one list.
+class CaptureList REF_COUNTED {
+public:
+    std::vector<int> syms;
+    std::vector<std::string> names;
+
+    // `syms` must be in increasing order
+    CaptureList(std::vector<int> syms);
+    // The index of `sym`, or -1 if it isn't captured
+    int index(int sym);
+};
+
+// What a closure keeps of the environment it was made in: the values
+// of just the variables its `_fun` captures, in a flat array, rather
+// than every enclosing binding
+class ClosureEnv : public Env {
+public:
+    PTR(CaptureList) captures;
+
+    // Captures the values of `captures` from `env`
+    ClosureEnv(PTR(CaptureList) captures, PTR(Env) env);
+    ClosureEnv(PTR(CaptureList) captures, std::vector<PTR(Val)> vals);
+    PTR(Val) find(const std::string &find_name);
+
+    // The value captured for `captures->syms[i]`, or nullptr if it
+    // wasn't bound
+    PTR(Val) val(size_t i) { return i < inline_count ? first[i] : more[i - inline_count]; }
+
+    // A closure's environment for `captures` in `env`
+    static PTR(Env) capture(PTR(CaptureList) captures, PTR(Env) env);
+
+protected:
+    PTR(Val) find_captured(int sym, std::atomic<int> &hint);
+
+private:
+    // most closures capture only a few variables, which then take no
+    // allocation besides the environment's own
+    static const size_t inline_count = 2;
+    PTR(Val) first[inline_count];
+    std::vector<PTR(Val)> more;
+
+    void set(size_t i, PTR(Val) val);
 };
 
 
@@ -3,9 +3,96 @@
 #include "env.hpp"
 #include "step.hpp"
 #include "cont.hpp"
+#include "trace.hpp"
+#include "parallel.hpp"
 
-NumExpr::NumExpr(int _rep) {
-  rep = _rep;
+bool Expr::containsVar() {
+    return !free_vars.empty();
+}
+
+// How tightly each kind of expression binds when printed, following
+// the grammar in parse.cpp, where `==`, `+` and `*` all group to the
+// right
+enum {
+    prec_none = 0,
+    prec_compare = 1,
+    prec_add = 2,
+    prec_mult = 3,
+    prec_call = 4
+};
+
+static std::string parens(std::string s) {
+    return "(" + s + ")";
+}
+
+// The number in `val`, which a typed node knows is a NumVal
+static const Number &num_rep(PTR(Val) const &val) {
+    return static_cast<NumVal *>(RAW(val))->rep;
+}
+
+std::string Expr::to_string() {
+    return to_string_prec(prec_none, true);
+}
+
+PTR(Expr) Expr::subst(std::string var, PTR(Val) val) {
+    return subst(Symbol::intern(var), val -> to_expr());
+}
+
+PTR(Expr) Expr::subst(int var, PTR(Expr) replacement) {
+    if (!free_vars.contains(var))
+        return THIS;
+    return subst_free(var, replacement);
+}
+
+// Renames the variable bound by a `_let` or `_fun` to a fresh name
+// within `body` if substituting `replacement` under it would
+// otherwise capture one of the replacement's free variables. The new
+// name is free in neither, nor in `avoid`, which is all that makes
+// the renaming safe, so it can be one an earlier rename used.
+static void avoid_capture(std::string &bound, int &bound_sym, PTR(Expr) &body,
+                          int var, PTR(Expr) replacement, VarSet avoid = VarSet()) {
+    if (!replacement -> free_vars.contains(bound_sym) || !body -> free_vars.contains(var))
+        return;
+    avoid.add_all(body -> free_vars);
+    avoid.add_all(replacement -> free_vars);
+    bound = Symbol::fresh(bound, avoid);
+    int old_sym = bound_sym;
+    bound_sym = Symbol::intern(bound);
+    body = body -> subst(old_sym, NEW(VarExpr)(bound, bound_sym));
+}
+
+// For the constructors, which compute Expr's fields in their
+// initializer lists: the union of `a` and `b`, and `vars` without
+// the ones in `bound`
+static VarSet union_of(VarSet a, const VarSet &b) {
+    a.add_all(b);
+    return a;
+}
+
+static VarSet without(VarSet vars, const std::vector<int> &bound) {
+    for (int sym : bound)
+        vars.remove(sym);
+    return vars;
+}
+
+static VarSet call_free_vars(PTR(Expr) const &to_be_called, const std::vector<PTR(Expr)> &args) {
+    VarSet vars = to_be_called->free_vars;
+    for (PTR(Expr) const &arg : args)
+        vars.add_all(arg->free_vars);
+    return vars;
+}
+
+static int call_size(PTR(Expr) const &to_be_called, const std::vector<PTR(Expr)> &args) {
+    int size = 1 + to_be_called->size;
+    for (PTR(Expr) const &arg : args)
+        size += arg->size;
+    return size;
+}
+
+//=====================================================
+
+NumExpr::NumExpr(Number _rep)
+    : Expr(VarSet(), true, 1, false), rep(_rep) {
 }
 
 bool NumExpr::equals(PTR(Expr) e) {
@@ -16,37 +103,36 @@ bool NumExpr::equals(PTR(Expr) e) {
     return rep == n->rep;
 }
 
-PTR(Val) NumExpr::interp(PTR(Env) env) {
+PTR(Val) NumExpr::interp_node(PTR(Env) env) {
   return NEW(NumVal)(rep);
 }
 
-PTR(Expr) NumExpr::subst(std::string var, PTR(Val) new_val) {
-  return NEW(NumExpr)(rep);
-}
-
-bool NumExpr::containsVar() {
-    return false;
+PTR(Expr) NumExpr::subst_free(int var, PTR(Expr) replacement) {
+  return THIS;
 }
 
 PTR(Expr) NumExpr::optimize() {
     return NEW(NumExpr)(rep);
 }
 
-std::string NumExpr::to_string() {
-    return std::to_string(rep);
+std::string NumExpr::to_string_prec(int prec, bool rightmost) {
+    return rep.to_string();
 }
 
 void NumExpr::step_interp() {
-    Step::mode = Step::continue_mode;
-    Step::val = NEW(NumVal)(rep);
+    Step::machine->mode = Step::continue_mode;
+    Step::machine->val = NEW(NumVal)(rep);
 }
 
 
 //=====================================================
 
-AddExpr::AddExpr(PTR(Expr) _lhs, PTR(Expr) _rhs) {
-  lhs = _lhs;
-  rhs = _rhs;
+// Pure only when typed, since otherwise it fails unless both sides
+// are numbers
+AddExpr::AddExpr(PTR(Expr) _lhs, PTR(Expr) _rhs, bool _typed)
+    : Expr(union_of(_lhs->free_vars, _rhs->free_vars), _typed && _lhs->pure && _rhs->pure,
+           1 + _lhs->size + _rhs->size, _lhs->calls || _rhs->calls),
+      lhs(_lhs), rhs(_rhs), typed(_typed) {
 }
 
 bool AddExpr::equals(PTR(Expr) e) {
@@ -58,55 +144,61 @@ bool AddExpr::equals(PTR(Expr) e) {
             && rhs->equals(a->rhs));
 }
 
-PTR(Val) AddExpr::interp(PTR(Env) env) {
+PTR(Val) AddExpr::interp_node(PTR(Env) env) {
 //    return lhs->interp(env)->add_to(rhs->interp(env));
     
-    PTR(Val) lhs_val = lhs -> interp(env);
-    PTR(Val) rhs_val = rhs -> interp(env);
+    PTR(Val) lhs_val;
+    PTR(Val) rhs_val;
+    Parallel::interp_both(lhs, rhs, env, lhs_val, rhs_val);
+    if (typed)
+        return NEW(NumVal)(num_rep(lhs_val) + num_rep(rhs_val));
     return lhs_val -> add_to(rhs_val);
 }
 
 
 
-PTR(Expr) AddExpr::subst(std::string var, PTR(Val) new_val) {
-    return NEW(AddExpr)(lhs->subst(var, new_val),
-                                rhs->subst(var, new_val));
-}
-
-bool AddExpr::containsVar() {
-    return lhs -> containsVar() || rhs -> containsVar();
+PTR(Expr) AddExpr::subst_free(int var, PTR(Expr) replacement) {
+    return NEW(AddExpr)(lhs->subst(var, replacement),
+                                rhs->subst(var, replacement));
 }
 
 PTR(Expr) AddExpr::optimize() {
     PTR(Expr) temp_lhs = lhs -> optimize();
     PTR(Expr) temp_rhs = rhs -> optimize();
-    if (!temp_lhs -> containsVar() && !temp_rhs -> containsVar()) {
-        return NEW(NumExpr)((CAST(NumExpr)(temp_lhs) -> rep )
-                            + (CAST(NumExpr)(temp_rhs) -> rep));
+    PTR(NumExpr) lhs_num = CAST(NumExpr)(temp_lhs);
+    PTR(NumExpr) rhs_num = CAST(NumExpr)(temp_rhs);
+    if (lhs_num != NULL && rhs_num != NULL) {
+        return NEW(NumExpr)(lhs_num -> rep + rhs_num -> rep);
     }
     return NEW(AddExpr)(temp_lhs, temp_rhs);
 }
 
 
-std::string AddExpr::to_string() {
-    return lhs -> to_string() + " + " + rhs -> to_string();
+std::string AddExpr::to_string_prec(int prec, bool rightmost) {
+    bool wrap = prec > prec_add;
+    std::string s = lhs -> to_string_prec(prec_mult, false) + " + " + rhs -> to_string_prec(prec_add, wrap || rightmost);
+    return wrap ? parens(s) : s;
 }
 
 
 void AddExpr::step_interp() {
-    Step::mode = Step::interp_mode;
-    Step::expr = lhs;
-    Step::env = Step::env;
-    
-    Step::cont = NEW(RightThenAddCont)(rhs, Step::env, Step::cont);
+    Step::machine->mode = Step::interp_mode;
+    // the continuation is made first: replacing the machine's
+    // expression can free this node when nothing else holds it, as
+    // when the machine was loaded from a checkpoint
+    Step::machine->cont = NEW(RightThenAddCont)(rhs, Step::machine->env, Step::machine->cont);
+    Step::machine->expr = lhs;
 }
 
 
 //=====================================================
 
-MultExpr::MultExpr(PTR(Expr) _lhs, PTR(Expr) _rhs) {
-  lhs = _lhs;
-  rhs = _rhs;
+// Pure only when typed, since otherwise it fails unless both sides
+// are numbers
+MultExpr::MultExpr(PTR(Expr) _lhs, PTR(Expr) _rhs, bool _typed)
+    : Expr(union_of(_lhs->free_vars, _rhs->free_vars), _typed && _lhs->pure && _rhs->pure,
+           1 + _lhs->size + _rhs->size, _lhs->calls || _rhs->calls),
+      lhs(_lhs), rhs(_rhs), typed(_typed) {
 }
 
 bool MultExpr::equals(PTR(Expr) e) {
@@ -118,49 +210,55 @@ bool MultExpr::equals(PTR(Expr) e) {
             && rhs->equals(m->rhs));
 }
 
-PTR(Val) MultExpr::interp(PTR(Env) env) {
-  return lhs->interp(env)->mult_with(rhs->interp(env));
+PTR(Val) MultExpr::interp_node(PTR(Env) env) {
+  PTR(Val) lhs_val;
+  PTR(Val) rhs_val;
+  Parallel::interp_both(lhs, rhs, env, lhs_val, rhs_val);
+  if (typed)
+    return NEW(NumVal)(num_rep(lhs_val) * num_rep(rhs_val));
+  return lhs_val->mult_with(rhs_val);
 }
 
-PTR(Expr) MultExpr::subst(std::string var, PTR(Val) new_val)
+PTR(Expr) MultExpr::subst_free(int var, PTR(Expr) replacement)
 {
-    return NEW(MultExpr)(lhs->subst(var, new_val), rhs->subst(var, new_val));
-}
-
-bool MultExpr::containsVar() {
-    return lhs -> containsVar() || rhs -> containsVar();
+    return NEW(MultExpr)(lhs->subst(var, replacement), rhs->subst(var, replacement));
 }
 
 
 PTR(Expr) MultExpr::optimize() {
     PTR(Expr) temp_lhs = lhs -> optimize();
     PTR(Expr) temp_rhs = rhs -> optimize();
-    if (!temp_lhs -> containsVar() && !temp_rhs -> containsVar()) {
-        return NEW(NumExpr)((CAST(NumExpr)(temp_lhs) -> rep )
-                            * (CAST(NumExpr)(temp_rhs) -> rep));
+    PTR(NumExpr) lhs_num = CAST(NumExpr)(temp_lhs);
+    PTR(NumExpr) rhs_num = CAST(NumExpr)(temp_rhs);
+    if (lhs_num != NULL && rhs_num != NULL) {
+        return NEW(NumExpr)(lhs_num -> rep * rhs_num -> rep);
     }
     return NEW(MultExpr)(temp_lhs, temp_rhs);
 }
 
 
-std::string MultExpr::to_string() {
-    return lhs -> to_string() + " * " + rhs -> to_string();
+std::string MultExpr::to_string_prec(int prec, bool rightmost) {
+    bool wrap = prec > prec_mult;
+    std::string s = lhs -> to_string_prec(prec_call, false) + " * " + rhs -> to_string_prec(prec_mult, wrap || rightmost);
+    return wrap ? parens(s) : s;
 }
 
 void MultExpr::step_interp() {
-    Step::mode = Step::interp_mode;
-    Step::expr = lhs;
-    Step::env = Step::env;
-    
-    Step::cont = NEW(RightThenMultCont)(rhs, Step::env, Step::cont);
-    
+    Step::machine->mode = Step::interp_mode;
+    // the continuation first, as in AddExpr::step_interp
+    Step::machine->cont = NEW(RightThenMultCont)(rhs, Step::machine->env, Step::machine->cont);
+    Step::machine->expr = lhs;
 }
 
 //=====================================================
 
 
-VarExpr::VarExpr(std::string _name) {
-  name = _name;
+VarExpr::VarExpr(std::string _name)
+    : VarExpr(_name, Symbol::intern(_name)) {
+}
+
+VarExpr::VarExpr(std::string _name, int _sym)
+    : Expr(VarSet(_sym), true, 1, false), name(_name), sym(_sym), hint(-1) {
 }
 
 bool VarExpr::equals(PTR(Expr) e) {
@@ -171,42 +269,35 @@ bool VarExpr::equals(PTR(Expr) e) {
     return name == v->name;
 }
 
-PTR(Val) VarExpr::interp(PTR(Env) env) {
-    return env -> lookup(name);
+PTR(Val) VarExpr::interp_node(PTR(Env) env) {
+    return env -> lookup(name, sym, hint);
 //  throw std::runtime_error("can not interpret variable");
 }
 
-PTR(Expr) VarExpr::subst(std::string var, PTR(Val) new_val) {
-  if (name == var)
-    return new_val->to_expr();
-  else
-    return NEW(VarExpr)(name);
-}
-
-bool VarExpr::containsVar() {
-    return true;
+PTR(Expr) VarExpr::subst_free(int var, PTR(Expr) replacement) {
+  return replacement;   // `var` is free here, so it's this variable
 }
 
 
 PTR(Expr) VarExpr::optimize() {
-    return NEW(VarExpr)(name);
+    return NEW(VarExpr)(name, sym);
 }
 
 
-std::string VarExpr::to_string() {
+std::string VarExpr::to_string_prec(int prec, bool rightmost) {
     return name;
 }
 
 void VarExpr::step_interp() {
-    Step::mode = Step::continue_mode;
-    Step::val = Step::env -> lookup(name);
+    Step::machine->mode = Step::continue_mode;
+    Step::machine->val = Step::machine->env -> lookup(name, sym, hint);
 }
 
 
 //=====================================================
 
-BoolExpr::BoolExpr(bool _rep) {
-  rep = _rep;
+BoolExpr::BoolExpr(bool _rep)
+    : Expr(VarSet(), true, 1, false), rep(_rep) {
 }
 
 bool BoolExpr::equals(PTR(Expr) e) {
@@ -217,16 +308,12 @@ bool BoolExpr::equals(PTR(Expr) e) {
     return rep == b->rep;
 }
 
-PTR(Val) BoolExpr::interp(PTR(Env) env) {
+PTR(Val) BoolExpr::interp_node(PTR(Env) env) {
   return NEW(BoolVal)(rep);
 }
 
-PTR(Expr) BoolExpr::subst(std::string var, PTR(Val) new_val) {
-  return NEW(BoolExpr)(rep);
-}
-
-bool BoolExpr::containsVar() {
-    return true;
+PTR(Expr) BoolExpr::subst_free(int var, PTR(Expr) replacement) {
+  return THIS;
 }
 
 PTR(Expr) BoolExpr::optimize() {
@@ -234,22 +321,26 @@ PTR(Expr) BoolExpr::optimize() {
 }
 
 
-std::string BoolExpr::to_string() {
+std::string BoolExpr::to_string_prec(int prec, bool rightmost) {
     return rep ? "_true" : "_false";
 }
 
 
 void BoolExpr::step_interp() {
-    Step::mode = Step::continue_mode;
-    Step::val = NEW(BoolVal)(rep);
+    Step::machine->mode = Step::continue_mode;
+    Step::machine->val = NEW(BoolVal)(rep);
 }
 
 //=====================================================
 
-LetExpr::LetExpr(std::string _varStr, PTR(Expr) _rhs, PTR(Expr) _body) {
-    varStr = _varStr;
-    rhs = _rhs;
-    body = _body;
+LetExpr::LetExpr(std::string _varStr, PTR(Expr) _rhs, PTR(Expr) _body)
+    : LetExpr(_varStr, Symbol::intern(_varStr), _rhs, _body) {
+}
+
+LetExpr::LetExpr(std::string _varStr, int _var_sym, PTR(Expr) _rhs, PTR(Expr) _body)
+    : Expr(union_of(without(_body->free_vars, {_var_sym}), _rhs->free_vars),
+           _rhs->pure && _body->pure, 1 + _rhs->size + _body->size, _rhs->calls || _body->calls),
+      varStr(_varStr), var_sym(_var_sym), rhs(_rhs), body(_body) {
 }
 
 bool LetExpr::equals(PTR(Expr) e) {
@@ -259,17 +350,32 @@ bool LetExpr::equals(PTR(Expr) e) {
     else return (l->varStr == varStr && l->rhs -> equals(rhs)) && l->body -> equals(body);
 }
 
-PTR(Expr) LetExpr::subst(std::string var, PTR(Val) val) {
-    if (var == varStr)
-        return NEW(LetExpr)(var, rhs, body);
-    else return NEW(LetExpr)(varStr, rhs-> subst(var, val), body -> subst(var, val));
+PTR(Expr) LetExpr::subst_free(int var, PTR(Expr) replacement) {
+    // the rhs is outside the binding, so it's substituted even when
+    // the body shadows `var`
+    PTR(Expr) new_rhs = rhs -> subst(var, replacement);
+    if (var == var_sym)
+        return NEW(LetExpr)(varStr, var_sym, new_rhs, body);
+    std::string new_var = varStr;
+    int new_sym = var_sym;
+    PTR(Expr) new_body = body;
+    avoid_capture(new_var, new_sym, new_body, var, replacement);
+    return NEW(LetExpr)(new_var, new_sym, new_rhs, new_body -> subst(var, replacement));
 }
 
 
 
-PTR(Val) LetExpr::interp(PTR(Env) env) {
+PTR(Val) LetExpr::interp_node(PTR(Env) env) {
     PTR(Val) rhs_val = rhs -> interp(env);
-    PTR(Env) new_env = NEW(ExtendedEnv) (env, varStr, rhs_val);
+    // Nothing keeps an environment once `interp` returns, since
+    // closures copy out the values they capture, so the frame can
+    // live here. (In steps, continuations keep it, so there it's NEW.)
+    LOCAL_NEW(ExtendedEnv, new_env, env, varStr, var_sym, rhs_val);
+    if (Trace::enabled) {
+        Trace::begin_let(var_sym, body);
+        TraceSpan span;
+        return body -> interp(new_env);
+    }
     return body -> interp(new_env);
 }
 
@@ -277,29 +383,26 @@ PTR(Val) LetExpr::interp(PTR(Env) env) {
 PTR(Expr) LetExpr::optimize() {
     PTR(Expr) temp_rhs = rhs -> optimize();
     PTR(Expr) temp_body = body -> optimize();
-    if (!temp_rhs -> containsVar()) {
-        PTR(Val) rhs_val = NEW(NumVal)(CAST(NumExpr)(temp_rhs)->rep);
-        return temp_body -> subst(varStr, rhs_val) -> optimize();
-    }
-    return NEW(LetExpr)(varStr, temp_rhs, temp_body);
-}
-
-bool LetExpr::containsVar() {
-    return NEW(LetExpr)(varStr, rhs, body) -> optimize() -> containsVar();
+    // drop a dead binding, as long as skipping its rhs can't hide an error
+    if (!temp_body -> free_vars.contains(var_sym) && temp_rhs -> pure)
+        return temp_body;
+    if (CAST(NumExpr)(temp_rhs) != NULL)
+        return temp_body -> subst(var_sym, temp_rhs) -> optimize();
+    return NEW(LetExpr)(varStr, var_sym, temp_rhs, temp_body);
 }
 
 
-std::string LetExpr::to_string() {
-    return "_let " + varStr + " = " + rhs -> to_string() + " _in " + body -> to_string();
+std::string LetExpr::to_string_prec(int prec, bool rightmost) {
+    std::string s = "_let " + varStr + " = " + rhs -> to_string() + " _in " + body -> to_string();
+    return rightmost ? s : parens(s);
 }
 
 
 void LetExpr::step_interp() {
-    Step::mode = Step::interp_mode;
-    Step::expr = rhs;
-    Step::env = Step::env;
-    
-    Step::cont = NEW(LetBodyCont)(varStr, body, Step::env, Step::cont);
+    Step::machine->mode = Step::interp_mode;
+    // the continuation first, as in AddExpr::step_interp
+    Step::machine->cont = NEW(LetBodyCont)(varStr, var_sym, body, Step::machine->env, Step::machine->cont);
+    Step::machine->expr = rhs;
 }
 
 
@@ -307,10 +410,12 @@ void LetExpr::step_interp() {
 //==========================================================================
 
 
-IfExpr::IfExpr(PTR(Expr) _condition, PTR(Expr) _then_part, PTR(Expr) _else_part) {
-    condition = _condition;
-    then_part = _then_part;
-    else_part = _else_part;
+IfExpr::IfExpr(PTR(Expr) _condition, PTR(Expr) _then_part, PTR(Expr) _else_part, bool _typed)
+    : Expr(union_of(union_of(_condition->free_vars, _then_part->free_vars), _else_part->free_vars),
+           _condition->pure && _then_part->pure && _else_part->pure,
+           1 + _condition->size + _then_part->size + _else_part->size,
+           _condition->calls || _then_part->calls || _else_part->calls),
+      condition(_condition), then_part(_then_part), else_part(_else_part), typed(_typed) {
 }
 
 
@@ -322,23 +427,25 @@ bool IfExpr::equals(PTR(Expr) e) {
     
 }
 
-PTR(Val) IfExpr::interp(PTR(Env) env) {
-    if (condition -> interp(env) -> is_true())
+PTR(Val) IfExpr::interp_node(PTR(Env) env) {
+    PTR(Val) condition_val = condition -> interp(env);
+    bool is_true;
+    if (typed)
+        is_true = static_cast<BoolVal *>(RAW(condition_val))->rep;
+    else
+        is_true = condition_val -> is_true();
+    if (is_true)
         return then_part -> interp(env);
     else
         return else_part -> interp(env);
 }
 
 
-PTR(Expr) IfExpr::subst(std::string _var, PTR(Val) val) {
-    return NEW(IfExpr)(condition->subst(_var, val), then_part->subst(_var, val), else_part->subst(_var, val));
+PTR(Expr) IfExpr::subst_free(int var, PTR(Expr) replacement) {
+    return NEW(IfExpr)(condition->subst(var, replacement), then_part->subst(var, replacement), else_part->subst(var, replacement));
 }
 
 
-bool IfExpr::containsVar() {
-    return true;
-}
-
 
 PTR(Expr) IfExpr::optimize() {
     PTR(BoolExpr) temp_condition = CAST(BoolExpr)(condition -> optimize());
@@ -349,26 +456,26 @@ PTR(Expr) IfExpr::optimize() {
 }
 
 
-std::string IfExpr::to_string() {
-    return "_if " + condition->to_string() + " _then " + then_part -> to_string() + " _else " + else_part -> to_string();
+std::string IfExpr::to_string_prec(int prec, bool rightmost) {
+    std::string s = "_if " + condition->to_string() + " _then " + then_part -> to_string() + " _else " + else_part -> to_string();
+    return rightmost ? s : parens(s);
 }
 
 
 void IfExpr::step_interp() {
-    Step::mode = Step::interp_mode;
-    Step::expr = condition;
-    Step::env = Step::env;
-    
-    Step::cont = NEW(IfBranchCont)(then_part, else_part, Step::env, Step::cont);
-    
+    Step::machine->mode = Step::interp_mode;
+    // the continuation first, as in AddExpr::step_interp
+    Step::machine->cont = NEW(IfBranchCont)(then_part, else_part, Step::machine->env, Step::machine->cont);
+    Step::machine->expr = condition;
 }
 
 
 //============================================================
 
-CompareExpr::CompareExpr(PTR(Expr) _lhs, PTR(Expr) _rhs) {
-    lhs = _lhs;
-    rhs = _rhs;
+CompareExpr::CompareExpr(PTR(Expr) _lhs, PTR(Expr) _rhs)
+    : Expr(union_of(_lhs->free_vars, _rhs->free_vars), _lhs->pure && _rhs->pure,
+           1 + _lhs->size + _rhs->size, _lhs->calls || _rhs->calls),
+      lhs(_lhs), rhs(_rhs) {
 }
 
 bool CompareExpr::equals(PTR(Expr) e) {
@@ -380,26 +487,29 @@ bool CompareExpr::equals(PTR(Expr) e) {
         return lhs->equals(ce->lhs) && rhs->equals(ce->rhs);
 }
 
-PTR(Val) CompareExpr::interp(PTR(Env) env) {
-    
-    if (lhs->interp(env)->equals(rhs->interp(env)))
+PTR(Val) CompareExpr::interp_node(PTR(Env) env) {
+    PTR(Val) lhs_val;
+    PTR(Val) rhs_val;
+    Parallel::interp_both(lhs, rhs, env, lhs_val, rhs_val);
+    if (lhs_val->equals(rhs_val))
         return NEW(BoolVal)(true);
     else return NEW(BoolVal)(false);
 }
 
-PTR(Expr) CompareExpr::subst(std::string var, PTR(Val) val) {
-    return NEW(CompareExpr)(lhs->subst(var, val), rhs->subst(var, val));
+PTR(Expr) CompareExpr::subst_free(int var, PTR(Expr) replacement) {
+    return NEW(CompareExpr)(lhs->subst(var, replacement), rhs->subst(var, replacement));
 }
 
-bool CompareExpr::containsVar() {
-    return true;
+// A literal's value is known without evaluating anything
+static bool is_literal(PTR(Expr) e) {
+    return CAST(NumExpr)(e) != NULL || CAST(BoolExpr)(e) != NULL;
 }
 
 PTR(Expr) CompareExpr::optimize() {
     PTR(Expr) temp_lhs = lhs->optimize();
     PTR(Expr) temp_rhs = rhs->optimize();
     
-    if (!temp_lhs -> containsVar() && !temp_rhs -> containsVar()) {
+    if (is_literal(temp_lhs) && is_literal(temp_rhs)) {
         if (temp_lhs -> equals(temp_rhs))
             return NEW(BoolExpr)(true);
         else return NEW(BoolExpr)(false);
@@ -408,61 +518,81 @@ PTR(Expr) CompareExpr::optimize() {
     return NEW(CompareExpr)(temp_lhs, temp_rhs);
 }
 
-std::string CompareExpr::to_string() {
-    return lhs->to_string() + " == " + rhs->to_string();
+std::string CompareExpr::to_string_prec(int prec, bool rightmost) {
+    bool wrap = prec > prec_compare;
+    std::string s = lhs->to_string_prec(prec_add, false) + " == " + rhs->to_string_prec(prec_compare, wrap || rightmost);
+    return wrap ? parens(s) : s;
 }
 
 
 void CompareExpr::step_interp() {
-    Step::mode = Step::interp_mode;
-    Step::expr = lhs;
-    Step::env = Step::env;
-    
-    Step::cont = NEW(RightThenCompCont)(rhs, Step::env, Step::cont);
+    Step::machine->mode = Step::interp_mode;
+    // the continuation first, as in AddExpr::step_interp
+    Step::machine->cont = NEW(RightThenCompCont)(rhs, Step::machine->env, Step::machine->cont);
+    Step::machine->expr = lhs;
 }
 
 
 //=============================================================
 
-FunExpr::FunExpr(std::string _formal_arg, PTR(Expr) _body) {
-    formal_arg = _formal_arg;
-    body = _body;
+static PTR(CaptureList) free_var_list(PTR(Expr) body, PTR(ParamList) params) {
+    // ids() is in increasing order, as CaptureList needs
+    return NEW(CaptureList)(without(body->free_vars, params->syms).ids());
+}
+
+FunExpr::FunExpr(std::string _formal_arg, PTR(Expr) _body)
+    : FunExpr(NEW(ParamList)(std::vector<std::string>{_formal_arg}), _body) {
+}
+
+// Calls nothing until it's called
+FunExpr::FunExpr(PTR(ParamList) _params, PTR(Expr) _body)
+    : Expr(without(_body->free_vars, _params->syms), true, 1 + _body->size, false),
+      params(_params), body(_body), captures(free_var_list(_body, _params)) {
 }
 
 bool FunExpr::equals(PTR(Expr) e) {
     PTR(FunExpr) l = CAST(FunExpr)(e);
     if (l == NULL)
         return false;
-    return l->formal_arg == formal_arg && l->body->equals(body);
+    return l->params->names == params->names && l->body->equals(body);
 }
 
-PTR(Val) FunExpr::interp(PTR(Env) env) {
-    return NEW(FunVal)(formal_arg, body, env);
+PTR(Val) FunExpr::interp_node(PTR(Env) env) {
+    return NEW(FunVal)(params, body, ClosureEnv::capture(captures, env));
 }
 
-PTR(Expr) FunExpr::subst(std::string var, PTR(Val) val) {
-    if (var == formal_arg)
-        return NEW(FunExpr)(formal_arg, body);
-    else return NEW(FunExpr)(formal_arg, body->subst(var, val));
-}
-
-bool FunExpr::containsVar() {
-    return true;
+PTR(Expr) FunExpr::subst_free(int var, PTR(Expr) replacement) {
+    // `var` is free, so no parameter shadows it
+    std::vector<std::string> new_formals = params->names;
+    PTR(Expr) new_body = body;
+    // a new name mustn't be another parameter's, even an unused one
+    VarSet formals;
+    for (int sym : params->syms)
+        formals.add(sym);
+    for (size_t i = 0; i < new_formals.size(); i++) {
+        int new_sym = params->syms[i];
+        avoid_capture(new_formals[i], new_sym, new_body, var, replacement, formals);
+        formals.add(new_sym);
+    }
+    PTR(ParamList) new_params = params;
+    if (new_formals != params->names)
+        new_params = NEW(ParamList)(new_formals);
+    return NEW(FunExpr)(new_params, new_body->subst(var, replacement));
 }
 
 PTR(Expr) FunExpr::optimize() {
-    body = body->optimize();
-    return NEW(FunExpr)(formal_arg, body);
+    return NEW(FunExpr)(params, body->optimize());
 }
 
-std::string FunExpr::to_string() {
-    return "_fun (" + formal_arg + ") " + body->to_string();
+std::string FunExpr::to_string_prec(int prec, bool rightmost) {
+    std::string s = "_fun " + params->to_string() + " " + body->to_string();
+    return rightmost ? s : parens(s);
 }
 
 
 void FunExpr::step_interp() {
-    Step::mode = Step::continue_mode;
-    Step::val = NEW(FunVal)(formal_arg, body, Step::env);
+    Step::machine->mode = Step::continue_mode;
+    Step::machine->val = NEW(FunVal)(params, body, ClosureEnv::capture(captures, Step::machine->env));
     
 }
 
@@ -471,48 +601,77 @@ void FunExpr::step_interp() {
 
 
 
-CallExpr::CallExpr(PTR(Expr) _to_be_called, PTR(Expr) _actual_arg) {
-    to_be_called = _to_be_called;
-    actual_arg = _actual_arg;
+CallExpr::CallExpr(PTR(Expr) _to_be_called, PTR(Expr) _actual_arg)
+    : CallExpr(_to_be_called, std::vector<PTR(Expr)>{_actual_arg}) {
+}
+
+// Never pure, since the callee may not return
+CallExpr::CallExpr(PTR(Expr) _to_be_called, std::vector<PTR(Expr)> _actual_args, bool _typed)
+    : Expr(call_free_vars(_to_be_called, _actual_args), false, call_size(_to_be_called, _actual_args), true),
+      to_be_called(_to_be_called), actual_args(_actual_args), typed(_typed) {
 }
 
 bool CallExpr::equals(PTR(Expr) e) {
     PTR(CallExpr) l = CAST(CallExpr)(e);
-    if (l == NULL)
+    if (l == NULL || l->actual_args.size() != actual_args.size())
         return false;
-    return l->to_be_called->equals(to_be_called) && l->actual_arg->equals(actual_arg);
-}
-
-PTR(Val) CallExpr::interp(PTR(Env) env) {
-    return to_be_called->interp(env)->call(actual_arg->interp(env));
-}
-
-PTR(Expr) CallExpr::subst(std::string var, PTR(Val) val) {
-    return NEW(CallExpr)(to_be_called->subst(var, val), actual_arg->subst(var, val));
+    for (size_t i = 0; i < actual_args.size(); i++)
+        if (!l->actual_args[i]->equals(actual_args[i]))
+            return false;
+    return l->to_be_called->equals(to_be_called);
+}
+
+// Calls `f`, which is a FunVal when the call is typed, without
+// going through the vtable then
+PTR(Val) CallExpr::call(PTR(Val) const &f, PTR(Val) const *vals, size_t count) {
+    if (typed)
+        return static_cast<FunVal *>(RAW(f))->FunVal::call(vals, count);
+    return f->call(vals, count);
+}
+
+PTR(Val) CallExpr::interp_node(PTR(Env) env) {
+    PTR(Val) f = to_be_called->interp(env);
+    // most calls have a few arguments, which then take no allocation
+    static const size_t inline_count = 4;
+    size_t count = actual_args.size();
+    if (count <= inline_count) {
+        PTR(Val) vals[inline_count];
+        for (size_t i = 0; i < count; i++)
+            vals[i] = actual_args[i]->interp(env);
+        return call(f, vals, count);
+    }
+    std::vector<PTR(Val)> vals;
+    for (PTR(Expr) const &arg : actual_args)
+        vals.push_back(arg->interp(env));
+    return call(f, vals.data(), count);
 }
 
-bool CallExpr::containsVar() {
-    return to_be_called->containsVar();
+PTR(Expr) CallExpr::subst_free(int var, PTR(Expr) replacement) {
+    std::vector<PTR(Expr)> new_args;
+    for (PTR(Expr) const &arg : actual_args)
+        new_args.push_back(arg->subst(var, replacement));
+    return NEW(CallExpr)(to_be_called->subst(var, replacement), new_args);
 }
 
 PTR(Expr) CallExpr::optimize() {
 //    to_be_called = to_be_called->optimize();
 //    actual_arg = actual_arg->optimize();
-    return NEW(CallExpr)(to_be_called, actual_arg);
+    return NEW(CallExpr)(to_be_called, actual_args);
 }
 
-std::string CallExpr::to_string() {
-    return to_be_called->to_string() + "(" + actual_arg->to_string() + ")";
+std::string CallExpr::to_string_prec(int prec, bool rightmost) {
+    std::string s = to_be_called->to_string_prec(prec_call, false) + "(";
+    for (size_t i = 0; i < actual_args.size(); i++)
+        s += (i == 0 ? "" : ", ") + actual_args[i]->to_string();
+    return s + ")";
 }
 
 
 void CallExpr::step_interp() {
-    Step::mode = Step::interp_mode;
-    Step::expr = to_be_called;
-    Step::env = Step::env;
-    
-    Step::cont = NEW(ArgThenCallCont)(actual_arg, Step::env, Step::cont);
-    
+    Step::machine->mode = Step::interp_mode;
+    // the continuation first, as in AddExpr::step_interp
+    Step::machine->cont = NEW(ArgThenCallCont)(actual_args, Step::machine->env, Step::machine->cont);
+    Step::machine->expr = to_be_called;
 }
 
 //=============================================================
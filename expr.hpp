@@ -1,128 +1,180 @@
 #ifndef expr_hpp
 #define expr_hpp
 
+#include <atomic>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "pointer.hpp"
+#include "symbol.hpp"
+#include "number.hpp"
+#include "profile.hpp"
+#include "value.hpp"
+#include "env.hpp"
 #include <iostream>
 
 
 class Val;
 class Env;
 
+// Expressions are immutable once constructed: passes such as
+// optimize, subst and specialize build new nodes, sharing the
+// subtrees they don't change. One parsed program can therefore be
+// evaluated on many threads at once, without locks or copies.
 class Expr ENABLE_THIS(Expr){
 public :
   virtual bool equals(PTR(Expr)) = 0;
   
   // To compute the number value of an expression,
   // assuming that all variables are 0
-  virtual PTR(Val) interp(PTR(Env) env) = 0;
+  PTR(Val) interp(PTR(Env) env);
   
-  // To substitute a number in place of a variable
-  virtual PTR(Expr) subst(std::string var, PTR(Val) val) = 0;
-  virtual bool containsVar() = 0;
+  // To substitute a value or an expression in place of a variable.
+  // Subtrees without a free occurrence of the variable are returned
+  // as they are rather than copied, and binders that would capture a
+  // free variable of the replacement are renamed.
+  PTR(Expr) subst(std::string var, PTR(Val) val);
+  PTR(Expr) subst(int var, PTR(Expr) replacement);
   virtual PTR(Expr) optimize() = 0;
-  virtual std::string to_string() = 0;
+  // Prints the expression so that it parses back to the same tree
+  std::string to_string();
+  // Does the work of `to_string`, adding parentheses if the
+  // expression binds less tightly than `prec` requires, or if it
+  // extends to the right (`_let`, `_if`, `_fun`) and isn't `rightmost`
+  virtual std::string to_string_prec(int prec, bool rightmost) = 0;
     virtual void step_interp() = 0;
+
+  // Computed once by each constructor, which passes them to Expr's:
+  // the variables this expression uses without binding them, whether
+  // evaluating it can neither fail nor diverge (provided those
+  // variables are bound), its size in nodes, and whether it calls a
+  // function, so that its cost isn't bounded by its size
+  const VarSet free_vars;
+  const bool pure;
+  const int size;
+  const bool calls;
+
+  bool containsVar();
+
+protected:
+  Expr(VarSet free_vars, bool pure, int size, bool calls)
+      : free_vars(std::move(free_vars)), pure(pure), size(size), calls(calls) { }
+
+  // Does the work of `subst`, which only calls it when `var` is free
+  virtual PTR(Expr) subst_free(int var, PTR(Expr) replacement) = 0;
+  // Does the work of `interp`, which goes through the profiler
+  // instead when it's on
+  virtual PTR(Val) interp_node(PTR(Env) env) = 0;
+
+  friend class Profile;
 };
 
 class NumExpr : public Expr{
 public:
-    int rep;
+    const Number rep;
 
-    NumExpr(int rep);
+    NumExpr(Number rep);
     bool equals(PTR(Expr));
   
-    PTR(Val) interp(PTR(Env) env);
-    PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+    PTR(Val) interp_node(PTR(Env) env);
+    PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
 
 class AddExpr : public Expr {
 public:
-  PTR(Expr) lhs;
-  PTR(Expr) rhs;
+  PTR(Expr) const lhs;
+  PTR(Expr) const rhs;
+  // Set by without_checks: both sides are known to be numbers
+  const bool typed;
 
-  AddExpr(PTR(Expr) lhs, PTR(Expr) rhs);
+  AddExpr(PTR(Expr) lhs, PTR(Expr) rhs, bool typed = false);
   bool equals(PTR(Expr) e);
 
-  PTR(Val) interp(PTR(Env) env);
-  PTR(Expr) subst(std::string var, PTR(Val) val);
-  bool containsVar();
+  PTR(Val) interp_node(PTR(Env) env);
+  PTR(Expr) subst_free(int var, PTR(Expr) replacement);
   PTR(Expr) optimize();
-  std::string to_string();
+  std::string to_string_prec(int prec, bool rightmost);
     
   void step_interp();
 };
 
 class MultExpr : public Expr {
 public:
-  PTR(Expr) lhs;
-  PTR(Expr) rhs;
+  PTR(Expr) const lhs;
+  PTR(Expr) const rhs;
+  // Set by without_checks: both sides are known to be numbers
+  const bool typed;
 
-  MultExpr(PTR(Expr) lhs, PTR(Expr) rhs);
+  MultExpr(PTR(Expr) lhs, PTR(Expr) rhs, bool typed = false);
   bool equals(PTR(Expr) e);
 
-  PTR(Val) interp(PTR(Env) env);
-  PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+  PTR(Val) interp_node(PTR(Env) env);
+  PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
 
 class VarExpr : public Expr {
 public:
-  std::string name;
+  const std::string name;
+  const int sym;
+  // Where this variable was found last time, for Env::lookup. It's
+  // only ever checked before use, so it's no exception to this node
+  // being immutable, and threads can share it.
+  std::atomic<int> hint;
 
   VarExpr(std::string name);
+  // For a `name` that is already interned as `sym`
+  VarExpr(std::string name, int sym);
   bool equals(PTR(Expr) e);
 
-  PTR(Val) interp(PTR(Env) env);
-  PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+  PTR(Val) interp_node(PTR(Env) env);
+  PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
 
 class BoolExpr : public Expr {
 public:
-    bool rep;
+    const bool rep;
   
     BoolExpr(bool rep);
     bool equals(PTR(Expr) e);
   
-    PTR(Val) interp(PTR(Env) env);
-    PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+    PTR(Val) interp_node(PTR(Env) env);
+    PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
 
 class LetExpr : public Expr {
 public:
-    std::string varStr;
-    PTR(Expr) rhs;
-    PTR(Expr) body;
+    const std::string varStr;
+    const int var_sym;
+    PTR(Expr) const rhs;
+    PTR(Expr) const body;
     
     
     LetExpr(std::string varStr, PTR(Expr) rhs, PTR(Expr) body);
+    // For a `varStr` that is already interned as `var_sym`
+    LetExpr(std::string varStr, int var_sym, PTR(Expr) rhs, PTR(Expr) body);
     bool equals(PTR(Expr) e);
     
-    PTR(Val) interp(PTR(Env) env);
-    PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+    PTR(Val) interp_node(PTR(Env) env);
+    PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
@@ -130,19 +182,19 @@ public:
 
 class IfExpr : public Expr {
 public:
-    PTR(Expr) condition;
-    PTR(Expr) then_part;
-    PTR(Expr) else_part;
-    
+    PTR(Expr) const condition;
+    PTR(Expr) const then_part;
+    PTR(Expr) const else_part;
+    // Set by without_checks: the condition is known to be a boolean
+    const bool typed;
     
-    IfExpr(PTR(Expr) condition, PTR(Expr) then_part, PTR(Expr) else_part);
+    IfExpr(PTR(Expr) condition, PTR(Expr) then_part, PTR(Expr) else_part, bool typed = false);
     bool equals(PTR(Expr) e);
     
-    PTR(Val) interp(PTR(Env) env);
-    PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+    PTR(Val) interp_node(PTR(Env) env);
+    PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
@@ -151,18 +203,17 @@ public:
 
 class CompareExpr : public Expr {
 public:
-    PTR(Expr) lhs;
-    PTR(Expr) rhs;
+    PTR(Expr) const lhs;
+    PTR(Expr) const rhs;
 
     
     CompareExpr(PTR(Expr) lhs, PTR(Expr) rhs);
     bool equals(PTR(Expr) e);
 
-    PTR(Val) interp(PTR(Env) env);
-    PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+    PTR(Val) interp_node(PTR(Env) env);
+    PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
@@ -170,37 +221,51 @@ public:
 
 class FunExpr : public Expr {
 public:
-    std::string formal_arg;
-    PTR(Expr) body;
+    PTR(ParamList) const params;
+    PTR(Expr) const body;
+    // the free variables, which are all that closures keep
+    PTR(CaptureList) const captures;
     
     FunExpr(std::string formal_arg, PTR(Expr) body);
+    FunExpr(PTR(ParamList) params, PTR(Expr) body);
     bool equals(PTR(Expr) e);
     
-    PTR(Val) interp(PTR(Env) env);
-    PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+    PTR(Val) interp_node(PTR(Env) env);
+    PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
 };
 
 class CallExpr : public Expr {
 public:
-    PTR(Expr) to_be_called;
-    PTR(Expr) actual_arg;
+    PTR(Expr) const to_be_called;
+    const std::vector<PTR(Expr)> actual_args;
+    // Set by without_checks: the callee is known to be a function
+    // that takes this many arguments
+    const bool typed;
     
     CallExpr(PTR(Expr) to_be_called, PTR(Expr) actual_arg);
+    CallExpr(PTR(Expr) to_be_called, std::vector<PTR(Expr)> actual_args, bool typed = false);
     bool equals(PTR(Expr) e);
     
-    PTR(Val) interp(PTR(Env) env);
-    PTR(Expr) subst(std::string var, PTR(Val) val);
-    bool containsVar();
+    PTR(Val) interp_node(PTR(Env) env);
+    PTR(Expr) subst_free(int var, PTR(Expr) replacement);
     PTR(Expr) optimize();
-    std::string to_string();
+    std::string to_string_prec(int prec, bool rightmost);
     
     void step_interp();
+
+private:
+    PTR(Val) call(PTR(Val) const &f, PTR(Val) const *vals, size_t count);
 };
 
 
+inline PTR(Val) Expr::interp(PTR(Env) env) {
+    if (Profile::enabled)
+        return Profile::interp(THIS, env);
+    return interp_node(env);
+}
+
 #endif /* expr_hpp */
@@ -0,0 +1,248 @@
+// Differential fuzzer: evaluates each generated program with every
+// engine and checks that they all agree with plain `interp` on the
+// value, or on the error reported. It also evaluates the program as
+// a batch of rows, which must agree the same way.
+//
+// Built normally, msdscript_fuzz is a standalone driver:
+//
+//   msdscript_fuzz [--seed N] [--runs N] [--depth N]
+//
+// Built with MSDSCRIPT_LIBFUZZER, it's a libFuzzer target, where each
+// input seeds the generator. Inputs aren't parsed as programs because
+// a program can loop forever.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parse.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "env.hpp"
+#include "step.hpp"
+#include "cse.hpp"
+#include "specialize.hpp"
+#include "memo.hpp"
+#include "parallel.hpp"
+#include "types.hpp"
+#include "checkpoint.hpp"
+#include "batch.hpp"
+#include "random_expr.hpp"
+
+// What evaluating a program came to, in a form that engines can
+// agree on: a number or boolean prints as itself, but functions only
+// as "function", since optimizing can change their bodies. An error
+// keeps its message, since an engine mustn't change which error is
+// reported.
+static std::string outcome(PTR(Expr) e, PTR(Val) (*engine)(PTR(Expr))) {
+    try {
+        PTR(Val) val = engine(e);
+        if (CAST(FunVal)(val) != nullptr)
+            return "function";
+        return val->to_string();
+    } catch (std::runtime_error &ex) {
+        return std::string("error: ") + ex.what();
+    }
+}
+
+static PTR(Val) run_interp(PTR(Expr) e) {
+    return e->interp(Env::empty);
+}
+
+static PTR(Val) run_steps(PTR(Expr) e) {
+    return Step::interp_by_steps(e);
+}
+
+// Saves the machine to a checkpoint and restores it every few steps,
+// which must lose nothing
+static PTR(Val) run_checkpointed(PTR(Expr) e) {
+    StepState state = Step::start(e);
+    while (!Step::run(state, 5)) {
+        std::stringstream checkpoint;
+        save_checkpoint(state, checkpoint);
+        state = load_checkpoint(checkpoint);
+    }
+    return state.val;
+}
+
+static PTR(Val) run_optimized(PTR(Expr) e) {
+    return e->optimize()->interp(Env::empty);
+}
+
+static PTR(Val) run_cse(PTR(Expr) e) {
+    return eliminate_common_subexprs(e)->interp(Env::empty);
+}
+
+static PTR(Val) run_specialized(PTR(Expr) e) {
+    return specialize(e, Env::empty)->interp(Env::empty);
+}
+
+static PTR(Val) run_memoized(PTR(Expr) e) {
+    Memo::enabled = true;
+    Memo::clear();
+    try {
+        PTR(Val) val = e->interp(Env::empty);
+        Memo::enabled = false;
+        return val;
+    } catch (...) {
+        Memo::enabled = false;
+        throw;
+    }
+}
+
+// Forks every operand it can, to check that doing so never changes
+// a value or which error is reported
+static PTR(Val) run_parallel(PTR(Expr) e) {
+    Parallel::enabled = true;
+    Parallel::min_size = 1;
+    Parallel::threads = 4;   // so operands get stolen even on one core
+    try {
+        PTR(Val) val = e->interp(Env::empty);
+        Parallel::enabled = false;
+        return val;
+    } catch (...) {
+        Parallel::enabled = false;
+        throw;
+    }
+}
+
+// Runs `e` without checks when it has a type, which must not change
+// anything, and with them otherwise
+static PTR(Val) run_typed(PTR(Expr) e) {
+    try {
+        infer_types(e);
+    } catch (std::runtime_error &) {
+        return e->interp(Env::empty);
+    }
+    return without_checks(e)->interp(Env::empty);
+}
+
+struct Engine {
+    const char *name;
+    PTR(Val) (*run)(PTR(Expr));
+};
+
+static const Engine engines[] = {
+    {"interp", run_interp},
+    {"interp_by_steps", run_steps},
+    {"checkpoint", run_checkpointed},
+    {"optimize", run_optimized},
+    {"cse", run_cse},
+    {"specialize", run_specialized},
+    {"memo", run_memoized},
+    {"parallel", run_parallel},
+    {"typed", run_typed},
+};
+
+// What interp_batch came to for a few rows, in the form of `outcome`.
+// The program has no inputs, so every row must come to the same.
+static std::string batch_outcome(PTR(Expr) e) {
+    const size_t rows = 3;
+    int64_t results[rows];
+    try {
+        bool booleans = interp_batch(e, Columns(), rows, results);
+        for (size_t row = 1; row < rows; row++)
+            if (results[row] != results[0])
+                return "rows differ";
+        if (booleans)
+            return results[0] ? "_true" : "_false";
+        return std::to_string(results[0]);
+    } catch (std::runtime_error &ex) {
+        // the message is "row 0: " and then the reason
+        std::string why = ex.what();
+        why = why.substr(why.find(": ") + 2);
+        // results that interp returns but a batch can't
+        const std::string out_of_range = "number out of range: ";
+        if (why.compare(0, out_of_range.size(), out_of_range) == 0)
+            return why.substr(out_of_range.size());
+        if (why == "result isn't a number or boolean")
+            return "function";
+        return "error: " + why;
+    }
+}
+
+// Returns true if every engine agrees about `program`, and otherwise
+// describes the disagreement on stderr
+static bool check_program(const std::string &program) {
+    std::istringstream in(program);
+    PTR(Expr) e = parse(in);
+
+    std::string expected = outcome(e, engines[0].run);
+    bool agree = true;
+    auto check = [&](const char *name, const std::string &got) {
+        if (got == expected)
+            return;
+        if (agree)
+            std::cerr << "engines disagree on: " << program << "\n"
+                      << "  interp: " << expected << "\n";
+        std::cerr << "  " << name << ": " << got << "\n";
+        agree = false;
+    };
+    for (const Engine &engine : engines)
+        check(engine.name, outcome(e, engine.run));
+    check("batch", batch_outcome(e));
+
+    // An operand that never finishes, after one that fails, mustn't
+    // keep the error from being reported, even if it's forked
+    if (expected.compare(0, 7, "error: ") == 0) {
+        std::istringstream then_diverge("(" + program + ") + "
+                                        "_let f = _fun (f) _fun (x) f(f)(x) _in f(f)(1)");
+        check("parallel, then diverging", outcome(parse(then_diverge), run_parallel));
+    }
+    return agree;
+}
+
+#ifdef MSDSCRIPT_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // FNV-1a, so that every byte of the input picks the program
+    uint32_t seed = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        seed = (seed ^ data[i]) * 16777619u;
+    srand(seed);
+    int depth = size > 0 ? 1 + data[0] % 4 : 2;
+    if (!check_program(random_program(depth)))
+        abort();
+    return 0;
+}
+
+#else
+
+int main(int argc, char **argv) {
+    unsigned seed = 1;
+    long runs = 10000;
+    int depth = 3;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atol(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else {
+            std::cerr << "usage: msdscript_fuzz [--seed N] [--runs N] [--depth N]\n";
+            return 1;
+        }
+    }
+
+    long failures = 0;
+    for (long run = 0; run < runs; run++) {
+        // each run has its own seed, so that a failure can be replayed
+        // with --seed <that seed> --runs 1
+        srand(seed + (unsigned)run);
+        if (!check_program(random_program(1 + run % depth))) {
+            std::cerr << "  (--seed " << seed + (unsigned)run << " --runs 1 --depth "
+                      << depth << ")\n";
+            failures++;
+        }
+    }
+    std::cout << runs << " programs, " << failures << " disagreements\n";
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
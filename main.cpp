@@ -2,43 +2,154 @@
 #include "parse.hpp"
 
 #define CATCH_CONFIG_RUNNER
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 #include "catch.hpp"
 
 #include <iostream>
 #include <string>
 #include <cstdlib>
 #include <vector>
+#include <sstream>
 #include "step.hpp"
 #include "value.hpp"
 #include "env.hpp"
+#include "cse.hpp"
+#include "specialize.hpp"
+#include "memo.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+#include "stats.hpp"
+#include "random_expr.hpp"
+#include "checkpoint.hpp"
+#include "parallel.hpp"
+#include "types.hpp"
+#include <fstream>
 
 
 
-static std::string random_expr(int nested);
-static std::string random_addend(int nested);
-static std::string random_inner(int nested);
-static std::string random_number();
-static std::string random_variable();
-static std::string random_let(int nested);
-//static std::string random_string(int number_of_numbers);
-
-int ITERATION = 100;
-
 int main(int argc, char **argv) {
 //    Catch::Session().run(argc, argv);
 
     
 
-     PTR(Expr) e = parse(std::cin);
+    bool opt = false, step_interp = false, spec = false, cse = false, typecheck = false;
+    std::string trace_path, checkpoint_path, resume_path;
+    long max_steps = 0, max_micros = 0;
+    PTR(Env) known = Env::empty;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--opt", 5) == 0)
+            opt = true;
+        else if (strncmp(argv[i], "--step_interp", 13) == 0)
+            step_interp = true;
+        else if (strncmp(argv[i], "--max_steps", 11) == 0 && i + 1 < argc)
+            max_steps = atol(argv[++i]);
+        else if (strncmp(argv[i], "--max_micros", 12) == 0 && i + 1 < argc)
+            max_micros = atol(argv[++i]);
+        else if (strncmp(argv[i], "--parallel", 10) == 0 && i + 1 < argc) {
+            Parallel::enabled = true;
+            Parallel::threads = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "--memo", 6) == 0)
+            Memo::enabled = true;
+        else if (strncmp(argv[i], "--stats", 7) == 0)
+            Stats::enabled = true;
+        else if (strncmp(argv[i], "--profile", 9) == 0)
+            Profile::enabled = Profile::count_allocations = true;
+        else if (strncmp(argv[i], "--trace", 7) == 0) {
+            if (i + 1 == argc)
+                throw std::runtime_error("--trace needs a file name");
+            trace_path = argv[++i];
+            Trace::enabled = true;
+        }
+        else if (strncmp(argv[i], "--checkpoint", 12) == 0 && i + 1 < argc)
+            checkpoint_path = argv[++i];
+        else if (strncmp(argv[i], "--resume", 8) == 0 && i + 1 < argc) {
+            resume_path = argv[++i];
+            step_interp = true;
+        }
+        else if (strncmp(argv[i], "--cse", 5) == 0)
+            cse = true;
+        else if (strncmp(argv[i], "--typecheck", 11) == 0)
+            typecheck = true;
+        else if (strncmp(argv[i], "--specialize", 12) == 0) {
+            // followed by the known inputs, as `name=expression`
+            spec = true;
+            while (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                std::string binding = argv[++i];
+                size_t eq = binding.find('=');
+                if (eq == std::string::npos)
+                    throw std::runtime_error("expected name=value, not " + binding);
+                std::istringstream in(binding.substr(eq + 1));
+                known = NEW(ExtendedEnv)(known, binding.substr(0, eq), parse(in)->interp(Env::empty));
+            }
+        }
+    }
 
-    if (argc == 2 && strncmp(argv[1], "--opt", 5) == 0)
+    // a resumed run continues from the checkpoint instead of stdin
+    PTR(Expr) e = nullptr;
+    if (resume_path.empty()) {
+        e = parse(std::cin);
+        if (cse)
+            e = eliminate_common_subexprs(e);
+        // an ill-typed program is rejected before it runs, and a
+        // well-typed one runs without checks
+        if (typecheck) {
+            Typing typing;
+            try {
+                typing = infer_types(e);
+            } catch (std::runtime_error &ex) {
+                std::cerr << ex.what() << "\n";
+                return 1;
+            }
+            std::cerr << "The type is : " << typing.type << "\n";
+            e = without_checks(e);
+        }
+    }
+
+    if (spec)
+        std::cout << "The specialization result is : " << specialize(e, known)->to_string() << "\n";
+    else if (opt)
         std::cout << "The optimization result is : " << e->optimize()->to_string() << "\n";
-    else if (argc == 2 && strncmp(argv[1], "--step_interp", 13) == 0) {
-        std::cout << "The interp_by_steps result is : " << Step::interp_by_steps(e) -> to_string() << "\n";
+    else if (step_interp) {
+        StepState state;
+        if (resume_path.empty())
+            state = Step::start(e);
+        else {
+            std::ifstream in(resume_path, std::ios::binary);
+            if (!in)
+                throw std::runtime_error("can't read " + resume_path);
+            state = load_checkpoint(in);
+        }
+        if (Step::run(state, max_steps, max_micros))
+            std::cout << "The interp_by_steps result is : " << state.val -> to_string() << "\n";
+        else {
+            std::cout << "The interp_by_steps was suspended after " << state.steps << " steps\n";
+            if (!checkpoint_path.empty()) {
+                std::ofstream out(checkpoint_path, std::ios::binary);
+                save_checkpoint(state, out);
+            }
+            return 1;
+        }
     }
     else
         std::cout << "The interpretation result is : " <<  e->interp(Env::empty)->to_string() << "\n";
 
+    if (Memo::enabled)
+        std::cerr << "memo: " << Memo::hits << " hits, " << Memo::misses << " misses\n";
+    if (Stats::enabled) {
+        Stats::enabled = false;
+        Stats::report(std::cerr);
+    }
+    if (Trace::enabled) {
+        Trace::enabled = false;
+        if (!Trace::write(trace_path))
+            std::cerr << "trace: can't write " << trace_path << "\n";
+    }
+    if (Profile::enabled) {
+        Profile::enabled = false;
+        Profile::report(std::cerr);
+    }
+
     
     
     
@@ -65,61 +176,3 @@ int main(int argc, char **argv) {
 //    if (result.exit_code != 0)
 //        std::cerr << "non-zero exit: " << result.exit_code << "\n";
 //}
-
-// generate random test
-std::string random_expr(int nested) {
-    if (nested == 0) return "0";
-    int number_of_addend = (rand() % 5) + 1;   // 1 to 5
-    std::vector<std::string>* addendVec = new std::vector<std::string>;
-    for (int i = 0; i < number_of_addend; i++) {
-        addendVec -> push_back(random_addend(nested));
-    }
-    std::string expr = "";
-    for (int i = 0; i < number_of_addend; i++) {
-        expr += addendVec -> at(i);
-        if (i != number_of_addend - 1) expr += " + ";
-    }
-    return expr;
-}
-
-std::string random_addend(int nested) {
-    if (nested == 0) return "0";
-    int number_of_inner = (rand() % 5) + 1;  // 1 to 5
-    std::vector<std::string>* addendVec = new std::vector<std::string>;
-    for (int i = 0; i < number_of_inner; i++) {
-        addendVec -> push_back(random_inner(nested));
-    }
-    std::string addend = "";
-    for (int i = 0; i < number_of_inner; i++) {
-        addend += addendVec -> at(i);
-        if (i != number_of_inner - 1) addend += " * ";
-    }
-    return addend;
-}
-
-std::string random_inner(int nested) {
-    if (nested == 0) return "0";
-    int type_of_inner = ((rand() % 4) + 1);     // 1 to 4
-    if (type_of_inner == 1) return random_number();
-    else if (type_of_inner == 2) return random_variable();
-    else if (type_of_inner == 3) return "(" + random_expr(nested - 1) + ")";
-    else if (type_of_inner == 4) return random_let(nested);
-    return "";
-}
-
-// generate a random number ranging from 0 to 99
-std::string random_number() {
-    return std::to_string(rand()%100);
-}
-
-// generate a random varaible name which only contains lowercase letters
-std::string random_variable() {
-    return std::string(1, (char) ((rand() % 26) + 'a'));
-}
-
-std::string random_let(int nested) {
-    std::string var = random_variable();
-    std::string rhs = random_expr(nested - 1);
-    std::string body = random_expr(nested - 1);
-    return "_let " + var + " = " + rhs + " _in " + body;
-}
@@ -0,0 +1,116 @@
+#include "memo.hpp"
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "value.hpp"
+
+bool Memo::enabled = false;
+size_t Memo::capacity = 100000;
+
+std::atomic<long> Memo::hits(0);
+std::atomic<long> Memo::misses(0);
+
+static std::atomic<uint64_t> last_serial(0);
+
+struct MemoArg {
+    int kind;           // 0 number, 1 boolean, 2 closure
+    int64_t value;
+
+    bool operator==(const MemoArg &other) const {
+        return kind == other.kind && value == other.value;
+    }
+};
+
+struct MemoKey {
+    uint64_t closure;
+    std::vector<MemoArg> args;
+
+    bool operator==(const MemoKey &other) const {
+        return closure == other.closure && args == other.args;
+    }
+};
+
+struct MemoKeyHash {
+    size_t operator()(const MemoKey &key) const {
+        size_t h = std::hash<uint64_t>()(key.closure);
+        for (const MemoArg &arg : key.args) {
+            h ^= std::hash<int64_t>()(arg.value) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            h = h * 3 + arg.kind;
+        }
+        return h;
+    }
+};
+
+struct MemoCache {
+    std::unordered_map<MemoKey, PTR(Val), MemoKeyHash> results;
+    std::deque<MemoKey> order;   // oldest first
+    // the key `find` looks up, kept so that its arguments' storage is
+    // reused instead of allocated on every call
+    MemoKey probe;
+};
+
+static thread_local MemoCache cache;
+
+// Fills in `key` for calling closure `serial` on the `count`
+// arguments at `args`; returns false if one of them can't be part of
+// a key
+static bool make_key(uint64_t serial, PTR(Val) const *args, size_t count, MemoKey &key) {
+    key.closure = serial;
+    key.args.clear();
+    for (size_t i = 0; i < count; i++) {
+        MemoArg arg;
+        if (PTR(NumVal) n = CAST(NumVal)(args[i])) {
+            if (!n->rep.is_small())
+                return false;
+            arg = {0, n->rep.small_value()};
+        } else if (PTR(BoolVal) b = CAST(BoolVal)(args[i])) {
+            arg = {1, b->rep};
+        } else if (PTR(FunVal) f = CAST(FunVal)(args[i])) {
+            if (f->serial == 0)
+                return false;
+            arg = {2, (int64_t)f->serial};
+        } else
+            return false;
+        key.args.push_back(arg);
+    }
+    return true;
+}
+
+uint64_t Memo::next_serial() {
+    if (!enabled)
+        return 0;
+    return last_serial.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+PTR(Val) Memo::find(uint64_t serial, PTR(Val) const *args, size_t count) {
+    MemoKey &key = cache.probe;
+    if (!make_key(serial, args, count, key))
+        return nullptr;
+    auto found = cache.results.find(key);
+    if (found == cache.results.end()) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return found->second;
+}
+
+void Memo::remember(uint64_t serial, PTR(Val) const *args, size_t count, PTR(Val) result) {
+    MemoKey key;
+    if (capacity == 0 || !make_key(serial, args, count, key))
+        return;
+    if (!cache.results.emplace(key, result).second)
+        return;
+    cache.order.push_back(key);
+    while (cache.order.size() > capacity) {
+        cache.results.erase(cache.order.front());
+        cache.order.pop_front();
+    }
+}
+
+void Memo::clear() {
+    cache.results.clear();
+    cache.order.clear();
+}
@@ -0,0 +1,42 @@
+#ifndef memo_hpp
+#define memo_hpp
+
+#include <stdint.h>
+#include <atomic>
+
+#include "pointer.hpp"
+
+class Val;
+
+// Opt-in memoization of function calls. msdscript has no side
+// effects, so every function is pure: calling the same closure on
+// the same argument always gives the same result, and a call that
+// fails or doesn't return is never recorded.
+//
+// Results are keyed on the closure and all of its arguments. Numbers
+// and booleans compare by value and closures by identity, using a
+// serial number that each FunVal gets when it's created with
+// memoization on.
+// Each thread keeps at most `capacity` results, dropping the oldest.
+class Memo {
+public:
+    static bool enabled;
+    static size_t capacity;
+
+    static std::atomic<long> hits;
+    static std::atomic<long> misses;
+
+    // A serial number for a new closure, or 0 when it can't be
+    // memoized because memoization is off
+    static uint64_t next_serial();
+
+    // The remembered result of calling closure `serial` on the
+    // `count` arguments at `args`, or nullptr
+    static PTR(Val) find(uint64_t serial, PTR(Val) const *args, size_t count);
+    static void remember(uint64_t serial, PTR(Val) const *args, size_t count, PTR(Val) result);
+
+    // Forgets this thread's results
+    static void clear();
+};
+
+#endif /* memo_hpp */
@@ -0,0 +1,55 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "env.hpp"
+#include "expr.hpp"
+#include "memo.hpp"
+#include "parse.hpp"
+#include "step.hpp"
+#include "value.hpp"
+
+// Runs `source` with memoization on, returning its result and setting
+// the hits and misses it caused
+static std::string run_memoized(const std::string &source, bool by_steps, long &hits, long &misses) {
+    Memo::enabled = true;
+    Memo::clear();
+    long hits_before = Memo::hits;
+    long misses_before = Memo::misses;
+    std::istringstream in(source);
+    PTR(Expr) e = parse(in);
+    std::string result = by_steps ? Step::interp_by_steps(e)->to_string()
+                                  : e->interp(Env::empty)->to_string();
+    hits = Memo::hits - hits_before;
+    misses = Memo::misses - misses_before;
+    Memo::clear();
+    Memo::enabled = false;
+    return result;
+}
+
+TEST_CASE("Memo keys on every argument") {
+    const char *fib =
+        "_let fib = _fun (fib, x)"
+        "  _if x == 0 _then 0"
+        "  _else _if x == 1 _then 1"
+        "  _else fib(fib, x + -1) + fib(fib, x + -2)"
+        " _in fib(fib, 20)";
+    for (bool by_steps : {false, true}) {
+        INFO("by steps: " << by_steps);
+        long hits, misses;
+        CHECK(run_memoized(fib, by_steps, hits, misses) == "6765");
+        // one miss per distinct x from 0 to 20, then a hit for each
+        // second call
+        CHECK(misses == 21);
+        CHECK(hits == 18);
+    }
+
+    // a call with the same first argument but a different second one
+    // isn't a hit
+    long hits, misses;
+    CHECK(run_memoized("_let f = _fun (x, y) x + y _in f(1, 2) + f(1, 3) + f(1, 2)",
+                       false, hits, misses) == "10");
+    CHECK(misses == 2);
+    CHECK(hits == 1);
+}
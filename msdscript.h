@@ -0,0 +1,74 @@
+#ifndef msdscript_h
+#define msdscript_h
+
+/* The C interface of libmsdscript, for embedding it in programs that
+   aren't C++. It mirrors Program, evaluate and evaluate_batch in
+   msdscriptapi.hpp. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct msdscript_program msdscript_program;
+
+enum msdscript_kind {
+    MSDSCRIPT_NUMBER,
+    MSDSCRIPT_BOOLEAN,
+    MSDSCRIPT_FUNCTION      /* only as a result, which can't be passed back */
+};
+
+typedef struct {
+    int kind;               /* an msdscript_kind */
+    int64_t number;         /* the number, or 0 or 1 for a boolean */
+} msdscript_value;
+
+typedef struct {
+    const char *name;
+    msdscript_value value;
+} msdscript_binding;
+
+typedef struct {
+    const char *name;
+    int kind;               /* MSDSCRIPT_NUMBER or MSDSCRIPT_BOOLEAN */
+    const int64_t *values;  /* one per row, not copied */
+} msdscript_column;
+
+/* Parses and optimizes `source`. Returns NULL on a parse error, and
+   if `error` isn't NULL, sets it to a message to free with
+   msdscript_free_string. */
+msdscript_program *msdscript_compile(const char *source, char **error);
+
+void msdscript_free_program(msdscript_program *program);
+
+/* The number of inputs `program` has, and the name of input `index`,
+   which lives as long as the program, or NULL if there aren't that
+   many inputs */
+size_t msdscript_input_count(const msdscript_program *program);
+const char *msdscript_input_name(const msdscript_program *program, size_t index);
+
+/* Evaluates `program` with the `count` inputs in `bindings`, setting
+   `*result`. Returns 0, or -1 if evaluation fails, setting `error`
+   as for msdscript_compile. */
+int msdscript_evaluate(msdscript_program *program,
+                       const msdscript_binding *bindings, size_t count,
+                       msdscript_value *result, char **error);
+
+/* Evaluates `program` once per row, with the inputs of row i taken
+   from entry i of each of the `count` columns in `columns`, and
+   stores row i's result in `results[i]`, all of kind `*result_kind`.
+   Returns 0, or -1 if any row fails, as for msdscript_evaluate. */
+int msdscript_evaluate_batch(msdscript_program *program,
+                             const msdscript_column *columns, size_t count,
+                             size_t rows, int *result_kind, int64_t *results,
+                             char **error);
+
+void msdscript_free_string(char *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* msdscript_h */
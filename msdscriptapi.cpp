@@ -0,0 +1,156 @@
+#include "msdscriptapi.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "msdscript.h"
+#include "expr.hpp"
+#include "env.hpp"
+#include "symbol.hpp"
+#include "types.hpp"
+
+Program::Program(const std::string &source) {
+    std::istringstream in(source);
+    expr = parse(in)->optimize();
+    input_syms = expr->free_vars.ids();
+    for (int id : input_syms)
+        input_names.push_back(Symbol::name(id));
+    // programs that recurse by self-application have no type, but
+    // still run, with checks
+    typed_expr = nullptr;
+    try {
+        Typing typing = infer_types(expr);
+        for (const std::string &name : input_names)
+            input_types.push_back(typing.inputs.at(name));
+        typed_expr = without_checks(expr);
+    } catch (std::runtime_error &) {
+    }
+}
+
+// Whether `val` is sure to have `type`, so the program can run
+// without checks. Any value fits a type variable. A function type
+// can't be checked without calling the function, so a function input
+// always means running with checks, even when it would fit.
+static bool has_type(PTR(Val) val, const std::string &type) {
+    if (type == "num")
+        return CAST(NumVal)(val) != nullptr;
+    if (type == "bool")
+        return CAST(BoolVal)(val) != nullptr;
+    return type[0] == '\'';
+}
+
+PTR(Val) evaluate(Program &program, const Bindings &bindings) {
+    PTR(Env) env = Env::empty;
+    bool typed = program.typed_expr != nullptr;
+    // only the inputs it uses, so lookups don't walk past the rest
+    for (size_t i = 0; i < program.inputs().size(); i++) {
+        const std::string &name = program.inputs()[i];
+        auto found = bindings.find(name);
+        if (found != bindings.end()) {
+            env = NEW(ExtendedEnv)(env, name, program.input_symbols()[i], found->second);
+            typed = typed && has_type(found->second, program.types()[i]);
+        }
+    }
+    return (typed ? program.typed_expr : program.expr)->interp(env);
+}
+
+bool evaluate_batch(Program &program, const Columns &columns, size_t rows, int64_t *results) {
+    return interp_batch(program.expr, columns, rows, results);
+}
+
+//==============================================================
+
+struct msdscript_program {
+    Program program;
+};
+
+static void set_error(char **error, const char *message) {
+    if (error != NULL)
+        *error = strdup(message);
+}
+
+msdscript_program *msdscript_compile(const char *source, char **error) {
+    try {
+        return new msdscript_program{Program(source)};
+    } catch (std::exception &ex) {
+        set_error(error, ex.what());
+        return NULL;
+    }
+}
+
+void msdscript_free_program(msdscript_program *program) {
+    delete program;
+}
+
+size_t msdscript_input_count(const msdscript_program *program) {
+    return program->program.inputs().size();
+}
+
+const char *msdscript_input_name(const msdscript_program *program, size_t index) {
+    if (index >= program->program.inputs().size())
+        return NULL;
+    return program->program.inputs()[index].c_str();
+}
+
+static PTR(Val) from_c(msdscript_value value) {
+    switch (value.kind) {
+        case MSDSCRIPT_NUMBER:
+            return NEW(NumVal)(value.number);
+        case MSDSCRIPT_BOOLEAN:
+            return NEW(BoolVal)(value.number != 0);
+        default:
+            throw std::runtime_error("only numbers and booleans can be bound");
+    }
+}
+
+static msdscript_value to_c(PTR(Val) val) {
+    if (PTR(NumVal) n = CAST(NumVal)(val)) {
+        if (!n->rep.is_small())
+            throw std::runtime_error("number out of range: " + n->rep.to_string());
+        return {MSDSCRIPT_NUMBER, n->rep.small_value()};
+    }
+    if (PTR(BoolVal) b = CAST(BoolVal)(val))
+        return {MSDSCRIPT_BOOLEAN, b->rep ? 1 : 0};
+    return {MSDSCRIPT_FUNCTION, 0};
+}
+
+int msdscript_evaluate(msdscript_program *program,
+                       const msdscript_binding *bindings, size_t count,
+                       msdscript_value *result, char **error) {
+    try {
+        Bindings values;
+        for (size_t i = 0; i < count; i++)
+            values[bindings[i].name] = from_c(bindings[i].value);
+        *result = to_c(evaluate(program->program, values));
+        return 0;
+    } catch (std::exception &ex) {
+        set_error(error, ex.what());
+        return -1;
+    }
+}
+
+int msdscript_evaluate_batch(msdscript_program *program,
+                             const msdscript_column *columns, size_t count,
+                             size_t rows, int *result_kind, int64_t *results,
+                             char **error) {
+    try {
+        Columns inputs;
+        for (size_t i = 0; i < count; i++) {
+            if (columns[i].kind != MSDSCRIPT_NUMBER && columns[i].kind != MSDSCRIPT_BOOLEAN)
+                throw std::runtime_error("only numbers and booleans can be bound");
+            inputs[columns[i].name] = {columns[i].kind == MSDSCRIPT_BOOLEAN, columns[i].values};
+        }
+        bool booleans = evaluate_batch(program->program, inputs, rows, results);
+        *result_kind = booleans ? MSDSCRIPT_BOOLEAN : MSDSCRIPT_NUMBER;
+        return 0;
+    } catch (std::exception &ex) {
+        set_error(error, ex.what());
+        return -1;
+    }
+}
+
+void msdscript_free_string(char *s) {
+    free(s);
+}
@@ -1,12 +1,60 @@
-#ifndef parse_hpp
-#define parse_hpp
+#ifndef msdscriptapi_hpp
+#define msdscriptapi_hpp
 
-#include <iostream>
+// The embedding API of libmsdscript. A Program is parsed and
+// optimized once, then evaluated any number of times with different
+// values for its free variables.
 
-std::string interp(std::string s);
-std::string stepInterp(std::string s);
-std::string optimize(std::string s);
-bool equals(std::string s1, std::string s2);
+#include <map>
+#include <string>
+#include <vector>
 
+#include "pointer.hpp"
+#include "parse.hpp"
+#include "value.hpp"
+#include "batch.hpp"
 
-#endif /* parse_hpp */
+class Expr;
+
+class Program {
+public:
+    // Parses and optimizes `source`. Throws `runtime_error` for
+    // parse errors.
+    explicit Program(const std::string &source);
+
+    // The variables that evaluating needs values for
+    const std::vector<std::string> &inputs() const { return input_names; }
+    // Their interned symbols, so evaluating needn't intern them
+    const std::vector<int> &input_symbols() const { return input_syms; }
+    // Their types, as in types.hpp, when `typed_expr` isn't nullptr
+    const std::vector<std::string> &types() const { return input_types; }
+
+    // The optimized program
+    PTR(Expr) expr;
+    // The same without checks, if it has a type, or nullptr
+    PTR(Expr) typed_expr;
+
+private:
+    std::vector<std::string> input_names;
+    std::vector<int> input_syms;
+    std::vector<std::string> input_types;
+};
+
+// Values for a program's inputs, by name
+typedef std::map<std::string, PTR(Val)> Bindings;
+
+// Evaluates `program` with its inputs bound as in `bindings`. Throws
+// `runtime_error` if evaluation fails, including when an input it
+// uses isn't bound. Runs `typed_expr` when the program has a type
+// and every input fits its type: a number for `num`, a boolean for
+// `bool`, and anything for a type variable. An input whose type is a
+// function type can't be checked, so then `expr` runs instead, with
+// checks, which gives the same result.
+PTR(Val) evaluate(Program &program, const Bindings &bindings);
+
+// Evaluates `program` once for each of `rows` rows of `columns`, as
+// described for `interp_batch`, which is much faster than calling
+// `evaluate` per row
+bool evaluate_batch(Program &program, const Columns &columns, size_t rows, int64_t *results);
+
+#endif /* msdscriptapi_hpp */
@@ -0,0 +1,143 @@
+#include "catch.hpp"
+
+#include <string>
+
+#include "msdscript.h"
+
+// Compiles `source`, which must parse
+static msdscript_program *compile(const char *source) {
+    char *error = NULL;
+    msdscript_program *program = msdscript_compile(source, &error);
+    REQUIRE(program != NULL);
+    REQUIRE(error == NULL);
+    return program;
+}
+
+// Evaluates `program` with `bindings`, returning the message of the
+// error it fails with, or "" if it doesn't
+static std::string evaluate(msdscript_program *program, const msdscript_binding *bindings,
+                            size_t count, msdscript_value *result) {
+    char *error = NULL;
+    int status = msdscript_evaluate(program, bindings, count, result, &error);
+    CHECK((status == 0) == (error == NULL));
+    if (error == NULL)
+        return "";
+    std::string message = error;
+    msdscript_free_string(error);
+    return message;
+}
+
+TEST_CASE("msdscript_compile") {
+    char *error = NULL;
+    CHECK(msdscript_compile("1 +", &error) == NULL);
+    REQUIRE(error != NULL);
+    CHECK(std::string(error) != "");
+    msdscript_free_string(error);
+
+    // the error can be ignored
+    CHECK(msdscript_compile("_let", NULL) == NULL);
+}
+
+TEST_CASE("msdscript_input_name") {
+    msdscript_program *program = compile("x * y + x");
+    REQUIRE(msdscript_input_count(program) == 2);
+    std::string first = msdscript_input_name(program, 0);
+    std::string second = msdscript_input_name(program, 1);
+    CHECK(((first == "x" && second == "y") || (first == "y" && second == "x")));
+    CHECK(msdscript_input_name(program, 2) == NULL);
+    CHECK(msdscript_input_name(program, (size_t)-1) == NULL);
+    msdscript_free_program(program);
+
+    program = compile("_let x = 1 _in x");
+    CHECK(msdscript_input_count(program) == 0);
+    CHECK(msdscript_input_name(program, 0) == NULL);
+    msdscript_free_program(program);
+}
+
+TEST_CASE("msdscript_evaluate") {
+    msdscript_program *program = compile("_if b _then n * 2 _else n + 1");
+    msdscript_binding bindings[] = {
+        {"b", {MSDSCRIPT_BOOLEAN, 1}},
+        {"n", {MSDSCRIPT_NUMBER, 21}},
+    };
+    msdscript_value result;
+    CHECK(evaluate(program, bindings, 2, &result) == "");
+    CHECK(result.kind == MSDSCRIPT_NUMBER);
+    CHECK(result.number == 42);
+
+    // any nonzero number is true
+    bindings[0].value.number = 7;
+    CHECK(evaluate(program, bindings, 2, &result) == "");
+    CHECK(result.number == 42);
+    bindings[0].value.number = 0;
+    CHECK(evaluate(program, bindings, 2, &result) == "");
+    CHECK(result.number == 22);
+
+    // the same program, evaluated with checks when an input doesn't
+    // fit its type
+    bindings[1].value.kind = MSDSCRIPT_BOOLEAN;
+    CHECK(evaluate(program, bindings, 2, &result) != "");
+
+    CHECK(evaluate(program, bindings, 1, &result) == "free variable: n");
+
+    bindings[1].value.kind = MSDSCRIPT_FUNCTION;
+    CHECK(evaluate(program, bindings, 2, &result) == "only numbers and booleans can be bound");
+    msdscript_free_program(program);
+}
+
+TEST_CASE("msdscript_evaluate results") {
+    msdscript_value result;
+
+    msdscript_program *program = compile("x == 3");
+    msdscript_binding three = {"x", {MSDSCRIPT_NUMBER, 3}};
+    CHECK(evaluate(program, &three, 1, &result) == "");
+    CHECK(result.kind == MSDSCRIPT_BOOLEAN);
+    CHECK(result.number == 1);
+    msdscript_free_program(program);
+
+    program = compile("_fun (x) x");
+    CHECK(evaluate(program, NULL, 0, &result) == "");
+    CHECK(result.kind == MSDSCRIPT_FUNCTION);
+    msdscript_free_program(program);
+
+    // the whole int64_t range goes in, but only it comes out
+    program = compile("x + 1");
+    msdscript_binding big = {"x", {MSDSCRIPT_NUMBER, INT64_MAX - 1}};
+    CHECK(evaluate(program, &big, 1, &result) == "");
+    CHECK(result.number == INT64_MAX);
+    big.value.number = INT64_MAX;
+    CHECK(evaluate(program, &big, 1, &result) == "number out of range: 9223372036854775808");
+    msdscript_free_program(program);
+}
+
+TEST_CASE("msdscript_evaluate_batch") {
+    msdscript_program *program = compile("_if b _then n * 2 _else n + 1");
+    int64_t b[] = {1, 0, 1, 0};
+    int64_t n[] = {1, 2, 3, INT64_MAX};
+    msdscript_column columns[] = {
+        {"b", MSDSCRIPT_BOOLEAN, b},
+        {"n", MSDSCRIPT_NUMBER, n},
+    };
+    int64_t results[4];
+    int kind = -1;
+    char *error = NULL;
+    CHECK(msdscript_evaluate_batch(program, columns, 2, 3, &kind, results, &error) == 0);
+    CHECK(error == NULL);
+    CHECK(kind == MSDSCRIPT_NUMBER);
+    CHECK(results[0] == 2);
+    CHECK(results[1] == 3);
+    CHECK(results[2] == 6);
+
+    CHECK(msdscript_evaluate_batch(program, columns, 2, 4, &kind, results, &error) == -1);
+    REQUIRE(error != NULL);
+    CHECK(std::string(error) == "row 3: number out of range: 9223372036854775808");
+    msdscript_free_string(error);
+
+    columns[1].kind = MSDSCRIPT_FUNCTION;
+    error = NULL;
+    CHECK(msdscript_evaluate_batch(program, columns, 2, 3, &kind, results, &error) == -1);
+    REQUIRE(error != NULL);
+    CHECK(std::string(error) == "only numbers and booleans can be bound");
+    msdscript_free_string(error);
+    msdscript_free_program(program);
+}
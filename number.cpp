@@ -0,0 +1,183 @@
+#include "number.hpp"
+
+#include <algorithm>
+#include <functional>
+
+typedef std::vector<uint32_t> Magnitude;
+
+BigNum::BigNum(bool _negative, std::vector<uint32_t> _magnitude) {
+    negative = _negative;
+    magnitude = _magnitude;
+}
+
+static int compare_magnitudes(const Magnitude &a, const Magnitude &b) {
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0; )
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+static Magnitude add_magnitudes(const Magnitude &a, const Magnitude &b) {
+    Magnitude sum;
+    uint64_t carry = 0;
+    for (size_t i = 0; i < std::max(a.size(), b.size()); i++) {
+        carry += (uint64_t)(i < a.size() ? a[i] : 0) + (i < b.size() ? b[i] : 0);
+        sum.push_back((uint32_t)carry);
+        carry >>= 32;
+    }
+    if (carry != 0)
+        sum.push_back((uint32_t)carry);
+    return sum;
+}
+
+// `a - b`, where `a` is at least `b`
+static Magnitude subtract_magnitudes(const Magnitude &a, const Magnitude &b) {
+    Magnitude difference;
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t d = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = d < 0;
+        difference.push_back((uint32_t)(d + (borrow << 32)));
+    }
+    return difference;
+}
+
+static Magnitude multiply_magnitudes(const Magnitude &a, const Magnitude &b) {
+    Magnitude product(a.size() + b.size(), 0);
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); j++) {
+            carry += (uint64_t)a[i] * b[j] + product[i + j];
+            product[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        product[i + b.size()] = (uint32_t)carry;
+    }
+    return product;
+}
+
+// Sets `m` to `m * factor + addend`
+static void multiply_add(Magnitude &m, uint32_t factor, uint32_t addend) {
+    uint64_t carry = addend;
+    for (uint32_t &word : m) {
+        carry += (uint64_t)word * factor;
+        word = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry != 0)
+        m.push_back((uint32_t)carry);
+}
+
+// Sets `m` to `m / divisor`, returning the remainder
+static uint32_t divide(Magnitude &m, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (size_t i = m.size(); i-- > 0; ) {
+        remainder = (remainder << 32) | m[i];
+        m[i] = (uint32_t)(remainder / divisor);
+        remainder %= divisor;
+    }
+    while (!m.empty() && m.back() == 0)
+        m.pop_back();
+    return (uint32_t)remainder;
+}
+
+void Number::unpack(bool &negative, Magnitude &magnitude) const {
+    if (!is_small()) {
+        negative = big->negative;
+        magnitude = big->magnitude;
+        return;
+    }
+    negative = small < 0;
+    uint64_t n = negative ? 0 - (uint64_t)small : (uint64_t)small;
+    magnitude.clear();
+    for (; n != 0; n >>= 32)
+        magnitude.push_back((uint32_t)n);
+}
+
+Number Number::pack(bool negative, Magnitude magnitude) {
+    while (!magnitude.empty() && magnitude.back() == 0)
+        magnitude.pop_back();
+    if (magnitude.size() <= 2) {
+        uint64_t n = 0;
+        for (size_t i = magnitude.size(); i-- > 0; )
+            n = (n << 32) | magnitude[i];
+        if (!negative && n <= (uint64_t)INT64_MAX)
+            return Number((int64_t)n);
+        if (negative && n <= (uint64_t)INT64_MAX + 1)
+            return Number((int64_t)(0 - n));
+    }
+    Number result;
+    result.big = NEW(BigNum)(negative, magnitude);
+    return result;
+}
+
+Number Number::parse(const std::string &digits, bool negative) {
+    Magnitude magnitude;
+    // nine digits at a time, which always fit in a word
+    size_t chunk = digits.size() % 9 == 0 ? 9 : digits.size() % 9;
+    for (size_t i = 0; i < digits.size(); i += chunk, chunk = 9) {
+        uint32_t factor = 1, addend = 0;
+        for (size_t j = i; j < i + chunk; j++) {
+            factor *= 10;
+            addend = addend * 10 + (digits[j] - '0');
+        }
+        multiply_add(magnitude, factor, addend);
+    }
+    return pack(negative, magnitude);
+}
+
+std::string Number::to_string() const {
+    if (is_small())
+        return std::to_string(small);
+    Magnitude m = big->magnitude;
+    std::string digits;
+    while (!m.empty()) {
+        uint32_t chunk = divide(m, 1000000000);
+        for (int i = 0; i < 9 && (chunk != 0 || !m.empty()); i++, chunk /= 10)
+            digits += (char)('0' + chunk % 10);
+    }
+    if (big->negative)
+        digits += '-';
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+size_t Number::hash() const {
+    if (is_small())
+        return std::hash<int64_t>()(small);
+    size_t h = big->negative;
+    for (uint32_t word : big->magnitude)
+        h = h * 31 + word;
+    return h;
+}
+
+bool Number::equals_big(const Number &other) const {
+    // a small Number never equals a big one, since each value has
+    // one representation
+    if (is_small() || other.is_small())
+        return false;
+    return big->negative == other.big->negative
+        && big->magnitude == other.big->magnitude;
+}
+
+Number Number::add_big(const Number &a, const Number &b) {
+    bool a_negative, b_negative;
+    Magnitude a_magnitude, b_magnitude;
+    a.unpack(a_negative, a_magnitude);
+    b.unpack(b_negative, b_magnitude);
+    if (a_negative == b_negative)
+        return pack(a_negative, add_magnitudes(a_magnitude, b_magnitude));
+    if (compare_magnitudes(a_magnitude, b_magnitude) >= 0)
+        return pack(a_negative, subtract_magnitudes(a_magnitude, b_magnitude));
+    return pack(b_negative, subtract_magnitudes(b_magnitude, a_magnitude));
+}
+
+Number Number::mult_big(const Number &a, const Number &b) {
+    bool a_negative, b_negative;
+    Magnitude a_magnitude, b_magnitude;
+    a.unpack(a_negative, a_magnitude);
+    b.unpack(b_negative, b_magnitude);
+    return pack(a_negative != b_negative, multiply_magnitudes(a_magnitude, b_magnitude));
+}
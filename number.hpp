@@ -0,0 +1,80 @@
+#ifndef number_hpp
+#define number_hpp
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "pointer.hpp"
+
+// The digits of a number that doesn't fit in 64 bits: a sign and a
+// magnitude in base 2^32, least significant first. Never changes
+// once made, so any number of Numbers can share one.
+class BigNum REF_COUNTED {
+public:
+    bool negative;
+    std::vector<uint32_t> magnitude;
+
+    BigNum(bool negative, std::vector<uint32_t> magnitude);
+};
+
+// An integer of any size. Ones that fit in an int64_t are held
+// inline, and arithmetic on them is one checked instruction; only
+// a result that overflows is moved to a BigNum, so that programs
+// that never overflow never allocate for numbers. Every value has
+// exactly one representation, so two Numbers are equal exactly
+// when their representations are.
+class Number {
+public:
+    Number(int64_t small = 0) : small(small), big(nullptr) { }
+    // Reads decimal `digits`, which must not be empty, negated if
+    // `negative`
+    static Number parse(const std::string &digits, bool negative);
+
+    bool is_small() const { return big == nullptr; }
+    // The value, when `is_small()`
+    int64_t small_value() const { return small; }
+    bool is_zero() const { return is_small() && small == 0; }
+    std::string to_string() const;
+    size_t hash() const;
+
+    bool operator==(const Number &other) const {
+        if (is_small() && other.is_small())
+            return small == other.small;
+        return equals_big(other);
+    }
+    bool operator!=(const Number &other) const { return !(*this == other); }
+
+    // Both operands being small and the result fitting is the only
+    // case that matters for speed, so it is tested with one branch
+    friend Number operator+(const Number &a, const Number &b) {
+        int64_t sum;
+        bool overflow = __builtin_add_overflow(a.small, b.small, &sum);
+        if (__builtin_expect(!overflow & a.is_small() & b.is_small(), 1))
+            return Number(sum);
+        return add_big(a, b);
+    }
+    friend Number operator*(const Number &a, const Number &b) {
+        int64_t product;
+        bool overflow = __builtin_mul_overflow(a.small, b.small, &product);
+        if (__builtin_expect(!overflow & a.is_small() & b.is_small(), 1))
+            return Number(product);
+        return mult_big(a, b);
+    }
+
+private:
+    // 0 when `big` is set, so that the checked arithmetic above can't
+    // go wrong on it before `big` is looked at
+    int64_t small;
+    PTR(BigNum) big;
+
+    // The sign and magnitude of any Number, and the Number with a
+    // given sign and magnitude
+    void unpack(bool &negative, std::vector<uint32_t> &magnitude) const;
+    static Number pack(bool negative, std::vector<uint32_t> magnitude);
+    bool equals_big(const Number &other) const;
+    static Number add_big(const Number &a, const Number &b);
+    static Number mult_big(const Number &a, const Number &b);
+};
+
+#endif /* number_hpp */
@@ -0,0 +1,65 @@
+#include "catch.hpp"
+
+#include <stdint.h>
+
+#include "number.hpp"
+
+static const Number max_small = Number(INT64_MAX);
+static const Number min_small = Number(INT64_MIN);
+
+TEST_CASE("Number promotes a result that overflows") {
+    Number sum = max_small + Number(1);
+    CHECK(!sum.is_small());
+    CHECK(sum.to_string() == "9223372036854775808");
+
+    Number product = min_small * Number(-1);
+    CHECK(!product.is_small());
+    CHECK(product.to_string() == "9223372036854775808");
+
+    Number below = min_small + Number(-1);
+    CHECK(!below.is_small());
+    CHECK(below.to_string() == "-9223372036854775809");
+
+    // the edges themselves stay small
+    CHECK((max_small + Number(0)).is_small());
+    CHECK((min_small * Number(1)).is_small());
+    CHECK((max_small * Number(-1)).small_value() == -INT64_MAX);
+}
+
+TEST_CASE("Number demotes a result that fits") {
+    Number big = max_small + Number(1);
+    Number back = big + Number(-1);
+    REQUIRE(back.is_small());
+    CHECK(back.small_value() == INT64_MAX);
+
+    Number zero = big * Number(0);
+    CHECK(zero.is_zero());
+    CHECK(zero.is_small());
+
+    Number min_back = (min_small * Number(-1)) * Number(-1);
+    REQUIRE(min_back.is_small());
+    CHECK(min_back.small_value() == INT64_MIN);
+}
+
+TEST_CASE("Number parses to the one representation") {
+    CHECK(Number::parse("9223372036854775807", false).is_small());
+    CHECK(Number::parse("9223372036854775808", true).is_small());
+    CHECK(Number::parse("9223372036854775808", true) == min_small);
+    CHECK(!Number::parse("9223372036854775808", false).is_small());
+    CHECK(Number::parse("00042", false) == Number(42));
+}
+
+TEST_CASE("Number compares small and big") {
+    Number big = max_small + Number(1);
+    CHECK(big == min_small * Number(-1));
+    CHECK(big == Number::parse("9223372036854775808", false));
+    CHECK(big.hash() == (min_small * Number(-1)).hash());
+
+    CHECK(big != max_small);
+    CHECK(max_small != big);
+    CHECK(big != min_small);
+    CHECK(big != Number(0));
+    // same magnitude, other sign
+    CHECK(big != Number::parse("9223372036854775808", false) * Number(-1));
+    CHECK(min_small + Number(-1) != min_small);
+}
@@ -0,0 +1,223 @@
+#include "parallel.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "value.hpp"
+#include "env.hpp"
+
+bool Parallel::enabled = false;
+int Parallel::threads = (int)std::thread::hardware_concurrency();
+int Parallel::min_size = 2000;
+
+namespace {
+
+// An operand queued by fork_join, which waits for it on its own stack
+struct Job {
+    PTR(Expr) expr;
+    PTR(Env) env;
+    PTR(Val) val;
+    std::exception_ptr error;
+    std::atomic<bool> done{false};
+
+    void run() {
+        try {
+            val = expr->interp(env);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        done.store(true, std::memory_order_release);
+    }
+};
+
+// The jobs forked by one thread. It pushes and pops its newest
+// while other threads steal its oldest.
+struct JobQueue {
+    std::mutex lock;
+    std::deque<Job *> jobs;
+};
+
+class Pool {
+public:
+    Pool();
+    ~Pool();
+
+    // This thread's queue, or nullptr if too many threads fork
+    JobQueue *own();
+    // Queues `job` for stealing, unless enough are queued already
+    bool push(JobQueue *queue, Job *job);
+    // Takes back this thread's newest job if it wasn't stolen
+    bool pop(JobQueue *queue, Job *job);
+    // Runs other threads' jobs until `job` is done
+    void join(JobQueue *queue, Job *job);
+
+private:
+    static const int max_queues = 256;
+    std::atomic<JobQueue *> queues[max_queues];
+    std::atomic<int> queue_count{0};
+    std::atomic<int> queued{0};
+
+    std::mutex idle_lock;
+    std::condition_variable work_queued;
+    std::atomic<int> sleeping{0};
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    Job *steal(int start);
+    void work();
+};
+
+Pool::Pool() {
+    for (int i = 0; i < max_queues; i++)
+        queues[i] = nullptr;
+    for (int i = 1; PTR_THREAD_SAFE && i < Parallel::threads; i++)
+        workers.push_back(std::thread(&Pool::work, this));
+}
+
+Pool::~Pool() {
+    {
+        std::lock_guard<std::mutex> hold(idle_lock);
+        stopping = true;
+    }
+    work_queued.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+JobQueue *Pool::own() {
+    static thread_local JobQueue *queue = nullptr;
+    static thread_local bool registered = false;
+    if (!registered) {
+        registered = true;
+        int index = queue_count.fetch_add(1);
+        if (index < max_queues) {
+            // kept until exit, since thieves may still be looking at it
+            queue = new JobQueue();
+            queues[index].store(queue, std::memory_order_release);
+        }
+    }
+    return queue;
+}
+
+bool Pool::push(JobQueue *queue, Job *job) {
+    if (queued.load(std::memory_order_relaxed) >= Parallel::threads)
+        return false;
+    {
+        std::lock_guard<std::mutex> hold(queue->lock);
+        queue->jobs.push_back(job);
+    }
+    queued++;
+    // a worker counts itself as sleeping before it checks `queued`,
+    // so one of them sees the other
+    if (sleeping > 0) {
+        std::lock_guard<std::mutex> hold(idle_lock);
+        work_queued.notify_one();
+    }
+    return true;
+}
+
+bool Pool::pop(JobQueue *queue, Job *job) {
+    std::lock_guard<std::mutex> hold(queue->lock);
+    // anything forked after `job` has been joined, so it's the newest
+    // unless it was stolen
+    if (queue->jobs.empty() || queue->jobs.back() != job)
+        return false;
+    queue->jobs.pop_back();
+    queued--;
+    return true;
+}
+
+// The oldest job of the first queue that has one, from `start` on
+Job *Pool::steal(int start) {
+    int count = std::min(queue_count.load(), (int)max_queues);
+    for (int i = 0; i < count; i++) {
+        JobQueue *queue = queues[(start + i) % count].load(std::memory_order_acquire);
+        if (queue == nullptr)
+            continue;
+        std::lock_guard<std::mutex> hold(queue->lock);
+        if (!queue->jobs.empty()) {
+            Job *job = queue->jobs.front();
+            queue->jobs.pop_front();
+            queued--;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void Pool::join(JobQueue *queue, Job *job) {
+    unsigned start = (unsigned)(uintptr_t)queue;
+    while (!job->done.load(std::memory_order_acquire)) {
+        // help rather than block, since the thief may be waiting on
+        // a job this thread could run
+        Job *other = queued > 0 ? steal(start++ % max_queues) : nullptr;
+        if (other != nullptr)
+            other->run();
+        else
+            std::this_thread::yield();
+    }
+}
+
+void Pool::work() {
+    int start = 0;
+    while (1) {
+        Job *job = steal(start++);
+        if (job != nullptr) {
+            job->run();
+            continue;
+        }
+        std::unique_lock<std::mutex> hold(idle_lock);
+        sleeping++;
+        work_queued.wait(hold, [this] { return stopping || queued > 0; });
+        sleeping--;
+        if (stopping)
+            return;
+    }
+}
+
+Pool &pool() {
+    static Pool the_pool;
+    return the_pool;
+}
+
+}
+
+void Parallel::fork_join(PTR(Expr) const &lhs, PTR(Expr) const &rhs, PTR(Env) const &env,
+                         PTR(Val) &lhs_val, PTR(Val) &rhs_val) {
+    Pool &p = pool();
+    JobQueue *queue = p.own();
+    Job job;
+    job.expr = rhs;
+    job.env = env;
+    if (!PTR_THREAD_SAFE || threads < 2 || queue == nullptr || !p.push(queue, &job)) {
+        lhs_val = lhs->interp(env);
+        rhs_val = rhs->interp(env);
+        return;
+    }
+
+    std::exception_ptr lhs_error;
+    try {
+        lhs_val = lhs->interp(env);
+    } catch (...) {
+        lhs_error = std::current_exception();
+    }
+
+    if (p.pop(queue, &job)) {
+        // not stolen, so there's no use evaluating it after a failure
+        if (lhs_error)
+            std::rethrow_exception(lhs_error);
+        rhs_val = rhs->interp(env);
+        return;
+    }
+    p.join(queue, &job);
+    if (lhs_error)
+        std::rethrow_exception(lhs_error);
+    if (job.error)
+        std::rethrow_exception(job.error);
+    rhs_val = job.val;
+}
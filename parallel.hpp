@@ -0,0 +1,51 @@
+#ifndef parallel_hpp
+#define parallel_hpp
+
+#include "pointer.hpp"
+#include "expr.hpp"
+
+class Env;
+class Val;
+
+// Opt-in fork-join evaluation of the two operands of `+`, `*` and
+// `==`. When both are worth it, the right one is queued for another
+// thread to steal while this thread evaluates the left one, and then
+// it's joined. msdscript has no side effects, so the values are the
+// same either way, and when an operand fails the left one's error
+// is the one reported, as it would be evaluating in order.
+//
+// Only a right operand that calls no function is forked, since it
+// is then sure to finish: when the left one fails, it is joined
+// before the error is reported, and one that never finished, or ran
+// out of stack, would keep the error from being reported at all.
+// Operands are worth forking when they call a function or are at
+// least `min_size` nodes, and only while fewer than `threads` forked
+// operands are waiting, so deep recursion doesn't queue one per call.
+// Nothing is forked when PTR counts aren't atomic.
+class Parallel {
+public:
+    static bool enabled;
+    static int threads;     // including the ones that fork
+    static int min_size;
+
+    // Sets `lhs_val` and `rhs_val` to the values of `lhs` and `rhs`
+    // in `env`, or throws the error of the first that fails
+    static void interp_both(PTR(Expr) const &lhs, PTR(Expr) const &rhs, PTR(Env) const &env,
+                            PTR(Val) &lhs_val, PTR(Val) &rhs_val) {
+        if (enabled && !rhs->calls && worth_forking(RAW(lhs)) && worth_forking(RAW(rhs)))
+            fork_join(lhs, rhs, env, lhs_val, rhs_val);
+        else {
+            lhs_val = lhs->interp(env);
+            rhs_val = rhs->interp(env);
+        }
+    }
+
+private:
+    static bool worth_forking(Expr *e) {
+        return e->calls || e->size >= min_size;
+    }
+    static void fork_join(PTR(Expr) const &lhs, PTR(Expr) const &rhs, PTR(Env) const &env,
+                          PTR(Val) &lhs_val, PTR(Val) &rhs_val);
+};
+
+#endif /* parallel_hpp */
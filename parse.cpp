@@ -5,6 +5,7 @@
 #include "expr.hpp"
 #include "value.hpp"
 #include "step.hpp"
+#include "cse.hpp"
 
 static PTR(Expr) parse_expr(std::istream &in);
 static PTR(Expr) parse_comparg(std::istream &in);
@@ -13,12 +14,14 @@ static PTR(Expr) parse_multicand(std::istream &in);
 static PTR(Expr) parse_inner(std::istream &in);
 static PTR(Expr) parse_number(std::istream &in);
 static PTR(Expr) parse_negative_number(std::istream &in);
+static Number parse_digits(std::istream &in, bool negative);
 static PTR(Expr) parse_variable(std::istream &in);
 static std::string parse_keyword(std::istream &in);
 static std::string parse_alphabetic(std::istream &in, std::string prefix);
 static PTR(Expr) parse_let(std::istream &in);
 static PTR(Expr) parse_if(std::istream &in);
 static PTR(Expr) parse_fun(std::istream &in);
+static std::vector<PTR(Expr)> parse_args(std::istream &in);
 static char peek_after_spaces(std::istream &in);
 
 // Take an input stream that contains an expression,
@@ -92,8 +95,8 @@ static PTR(Expr) parse_addend(std::istream &in) {
 static PTR(Expr) parse_multicand(std::istream &in) {
     PTR(Expr) e = parse_inner(in);
     while (peek_after_spaces(in) == '(') {
-        PTR(Expr) rhs = parse_inner(in);
-        e = NEW(CallExpr)(CallExpr(e, rhs));
+        std::vector<PTR(Expr)> args = parse_args(in);
+        e = NEW(CallExpr)(CallExpr(e, args));
     }
     
     return e;
@@ -142,16 +145,22 @@ static PTR(Expr) parse_inner(std::istream &in) {
 
 // Parses a number, assuming that `in` starts with a digit.
 static PTR(Expr) parse_number(std::istream &in) {
-  int num = 0;
-  in >> num;
-  return NEW(NumExpr)(num);
+  return NEW(NumExpr)(parse_digits(in, false));
 }
 
 static PTR(Expr) parse_negative_number(std::istream &in) {
     in.get();
-    int num = 0;
-    in >> num;
-    return NEW(NumExpr)(-num);
+    if (!isdigit(in.peek()))
+      throw std::runtime_error("expected a digit after -");
+    return NEW(NumExpr)(parse_digits(in, true));
+}
+
+// Reads a run of digits, of any length, negated if `negative`
+static Number parse_digits(std::istream &in, bool negative) {
+  std::string digits;
+  while (isdigit(in.peek()))
+    digits += (char)in.get();
+  return Number::parse(digits, negative);
 }
 
 // Parses an expression, assuming that `in` starts with a
@@ -236,15 +245,50 @@ static PTR(Expr) parse_if(std::istream &in) {
 }
 
 static PTR(Expr) parse_fun(std::istream &in) {
-    std::string formal_arg;
+    std::vector<std::string> formal_args;
     PTR(Expr) body;
     
-    peek_after_spaces(in);  // skip the blank space
-    formal_arg = parse_expr(in)->to_string();
+    if (peek_after_spaces(in) != '(')
+        throw std::runtime_error("expected ( after _fun");
+    in.get();   //consume
+    while (1) {
+        peek_after_spaces(in);
+        std::string formal_arg = parse_alphabetic(in, "");
+        if (formal_arg == "")
+            throw std::runtime_error("expected variables in parentheses after _fun");
+        for (const std::string &other : formal_args)
+            if (other == formal_arg)
+                throw std::runtime_error("duplicate parameter " + formal_arg);
+        formal_args.push_back(formal_arg);
+        char c = peek_after_spaces(in);
+        if (c == ')')
+            break;
+        if (c != ',')
+            throw std::runtime_error("expected variables in parentheses after _fun");
+        in.get();   //consume
+    }
+    in.get();   //consume
     
     peek_after_spaces(in);
     body = parse_expr(in);
-    return NEW(FunExpr)(FunExpr(formal_arg, body));
+    return NEW(FunExpr)(FunExpr(NEW(ParamList)(formal_args), body));
+}
+
+// Parses the parenthesized, comma-separated arguments of a call
+static std::vector<PTR(Expr)> parse_args(std::istream &in) {
+    std::vector<PTR(Expr)> args;
+    in.get();   //consume (
+    while (1) {
+        args.push_back(parse_expr(in));
+        char c = peek_after_spaces(in);
+        if (c == ')')
+            break;
+        if (c != ',')
+            throw std::runtime_error("expected a close parenthesis");
+        in.get();   //consume
+    }
+    in.get();   //consume
+    return args;
 }
 
 
@@ -284,6 +328,11 @@ std::string optimize(std::string s) {
     return e -> optimize() -> to_string();
 }
 
+std::string cse(std::string s) {
+    PTR(Expr) e = parse_str(s);
+    return eliminate_common_subexprs(e) -> to_string();
+}
+
 bool equals(std::string s1, std::string s2) {
     return parse_str(s1) -> optimize() -> equals(parse_str(s2) -> optimize());
 }
@@ -11,6 +11,7 @@ PTR(Expr) parse(std::istream &in);
 std::string interp(std::string s);
 std::string stepInterp(std::string s);
 std::string optimize(std::string s);
+std::string cse(std::string s);
 bool equals(std::string s1, std::string s2);
 
 
@@ -9,23 +9,267 @@
 #ifndef pointer_hpp
 #define pointer_hpp
 
+#include <memory>
+#include <type_traits>
+#include <utility>
 
+#include "stats.hpp"
 
-#if 0
+
+
+// The backend behind PTR is chosen when building, with
+// -DMSDSCRIPT_POINTER=shared|intrusive|raw:
+//
+//  - shared, the default: std::shared_ptr, which can be shared
+//    between threads.
+//  - intrusive: a count in each object that isn't atomic, making a
+//    handle one word with no separate control block. Evaluation must
+//    stay on one thread, so Parallel and Scheduler don't start any.
+//  - raw: plain pointers that are never freed, as a baseline.
+//
+// RAW(p) is the plain pointer behind `p`. LOCAL_NEW(T, p, args...)
+// declares `p`, a PTR(T) to a T(args...) that nothing keeps past the
+// enclosing block: on the stack, pointed to without owning it, where
+// the backend can do that, and from NEW where it can't. A class that NEW makes but
+// that doesn't use THIS is marked REF_COUNTED. PTR_THREAD_SAFE says
+// whether objects can be shared between threads, and PTR_BACKEND
+// names the backend.
+
+#if defined(MSDSCRIPT_POINTER_RAW)
 
 # define NEW(T) new T
-# define PRT(T) T*
+# define PTR(T) T*
 # define CAST(T) dynamic_cast<T*>
 # define THIS this
 # define ENABLE_THIS(T)
+# define REF_COUNTED
+# define RAW(p) (p)
+# define LOCAL_NEW(T, p, ...) T p##_local(__VA_ARGS__); T *p = &p##_local
+# define PTR_THREAD_SAFE 1
+# define PTR_BACKEND "raw"
+
+#elif defined(MSDSCRIPT_POINTER_INTRUSIVE)
+
+# define NEW(T) intrusive_new<T>
+# define PTR(T) intrusive_ptr<T>
+# define CAST(T) intrusive_cast<T>
+# define THIS intrusive_this(this)
+# define ENABLE_THIS(T) : public RefCounted
+# define REF_COUNTED : public RefCounted
+# define RAW(p) (p).get()
+// the count is in the object, so one on the stack would be deleted
+// when the last pointer to it went
+# define LOCAL_NEW(T, p, ...) PTR(T) p = NEW(T)(__VA_ARGS__)
+# define PTR_THREAD_SAFE 0
+# define PTR_BACKEND "intrusive"
+
+// The count of intrusive_ptrs to an object, which deletes it when
+// the last one goes
+class RefCounted {
+public:
+    RefCounted() noexcept { }
+    // a copy is a new object, with no pointers to it yet
+    RefCounted(const RefCounted &) noexcept { }
+    RefCounted &operator=(const RefCounted &) noexcept { return *this; }
+    virtual ~RefCounted() { }
+
+private:
+    template <class T> friend class intrusive_ptr;
+    long refs = 0;
+};
+
+// Counts its copies when Stats are on, like counted_ptr
+template <class T>
+class intrusive_ptr {
+    template <class U>
+    using if_convertible = typename std::enable_if<std::is_convertible<U *, T *>::value>::type;
+
+public:
+    typedef T element_type;
+
+    intrusive_ptr() noexcept : p(nullptr) { }
+    intrusive_ptr(std::nullptr_t) noexcept : p(nullptr) { }
+    explicit intrusive_ptr(T *_p) noexcept : p(_p) { retain(); }
+
+    intrusive_ptr(const intrusive_ptr &other) noexcept : p(other.p) { retain(); count_copy(); }
+    intrusive_ptr(intrusive_ptr &&other) noexcept : p(other.p) { other.p = nullptr; }
+    template <class U, class = if_convertible<U>>
+    intrusive_ptr(const intrusive_ptr<U> &other) noexcept : p(other.get()) { retain(); count_copy(); }
+    template <class U, class = if_convertible<U>>
+    intrusive_ptr(intrusive_ptr<U> &&other) noexcept : p(other.detach()) { }
+
+    ~intrusive_ptr() { release(); }
+
+    intrusive_ptr &operator=(const intrusive_ptr &other) noexcept {
+        T *old = p;
+        p = other.p;
+        retain();
+        count_copy();
+        release(old);
+        return *this;
+    }
+    intrusive_ptr &operator=(intrusive_ptr &&other) noexcept {
+        T *old = p;
+        p = other.p;
+        other.p = nullptr;
+        release(old);
+        return *this;
+    }
+
+    T *get() const noexcept { return p; }
+    T &operator*() const noexcept { return *p; }
+    T *operator->() const noexcept { return p; }
+    explicit operator bool() const noexcept { return p != nullptr; }
+
+    // Gives up this pointer's count without deleting
+    T *detach() noexcept {
+        T *q = p;
+        p = nullptr;
+        return q;
+    }
+
+private:
+    T *p;
+
+    void retain() const noexcept {
+        if (p != nullptr)
+            static_cast<RefCounted *>(p)->refs++;
+    }
+    static void release(T *q) noexcept {
+        // deleting through the base, whose destructor is virtual, saves
+        // instantiating T's wherever a pointer to it goes away
+        if (q != nullptr && --static_cast<RefCounted *>(q)->refs == 0)
+            delete static_cast<RefCounted *>(q);
+    }
+    void release() noexcept { release(p); }
+    void count_copy() const noexcept {
+        if (Stats::enabled && p != nullptr)
+            class_stats<T>().copies.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+template <class T, class U>
+bool operator==(const intrusive_ptr<T> &a, const intrusive_ptr<U> &b) noexcept { return a.get() == b.get(); }
+template <class T, class U>
+bool operator!=(const intrusive_ptr<T> &a, const intrusive_ptr<U> &b) noexcept { return a.get() != b.get(); }
+template <class T>
+bool operator==(const intrusive_ptr<T> &a, std::nullptr_t) noexcept { return a.get() == nullptr; }
+template <class T>
+bool operator!=(const intrusive_ptr<T> &a, std::nullptr_t) noexcept { return a.get() != nullptr; }
+template <class T>
+bool operator==(std::nullptr_t, const intrusive_ptr<T> &a) noexcept { return a.get() == nullptr; }
+template <class T>
+bool operator!=(std::nullptr_t, const intrusive_ptr<T> &a) noexcept { return a.get() != nullptr; }
+
+// Frees aren't counted, since deleting goes through the base class
+template <class T, class... Args>
+intrusive_ptr<T> intrusive_new(Args &&... args) {
+    if (Stats::enabled) {
+        ClassStats &stats = class_stats<T>();
+        stats.allocations.fetch_add(1, std::memory_order_relaxed);
+        stats.bytes.fetch_add(sizeof(T), std::memory_order_relaxed);
+    }
+    return intrusive_ptr<T>(new T(std::forward<Args>(args)...));
+}
+
+template <class T, class U>
+intrusive_ptr<T> intrusive_cast(const intrusive_ptr<U> &p) noexcept {
+    return intrusive_ptr<T>(dynamic_cast<T *>(p.get()));
+}
+
+template <class T>
+intrusive_ptr<T> intrusive_this(T *p) noexcept {
+    return intrusive_ptr<T>(p);
+}
 
 #else
 
-# define NEW(T) std::make_shared<T>
-# define PTR(T) std::shared_ptr<T>
+# define NEW(T) counted_new<T>
+# define PTR(T) counted_ptr<T>
 # define CAST(T) std::dynamic_pointer_cast<T>
 # define THIS shared_from_this()
 # define ENABLE_THIS(T) : public std::enable_shared_from_this<T>
+# define REF_COUNTED
+# define RAW(p) (p).get()
+# define LOCAL_NEW(T, p, ...) T p##_local(__VA_ARGS__); PTR(T) p = local_ptr(&p##_local)
+# define PTR_THREAD_SAFE 1
+# define PTR_BACKEND "shared"
+
+// Allocates through std::allocator, counting against `Owner` when
+// Stats are on. shared_ptr rebinds it to its control block, which
+// holds the object too, so the bytes are the whole allocation.
+template <class U, class Owner>
+class CountingAllocator {
+public:
+    typedef U value_type;
+    template <class V> struct rebind { typedef CountingAllocator<V, Owner> other; };
+
+    CountingAllocator() noexcept { }
+    template <class V> CountingAllocator(const CountingAllocator<V, Owner> &) noexcept { }
+
+    U *allocate(size_t n) {
+        if (Stats::enabled) {
+            ClassStats &stats = class_stats<Owner>();
+            stats.allocations.fetch_add(1, std::memory_order_relaxed);
+            stats.bytes.fetch_add(n * sizeof(U), std::memory_order_relaxed);
+        }
+        return std::allocator<U>().allocate(n);
+    }
+
+    void deallocate(U *p, size_t n) noexcept {
+        if (Stats::enabled)
+            class_stats<Owner>().frees.fetch_add(1, std::memory_order_relaxed);
+        std::allocator<U>().deallocate(p, n);
+    }
+
+    template <class V> bool operator==(const CountingAllocator<V, Owner> &) const noexcept { return true; }
+    template <class V> bool operator!=(const CountingAllocator<V, Owner> &) const noexcept { return false; }
+};
+
+// A shared_ptr that counts its copies when Stats are on
+template <class T>
+class counted_ptr : public std::shared_ptr<T> {
+    template <class U>
+    using if_convertible = typename std::enable_if<std::is_convertible<U *, T *>::value>::type;
+
+public:
+    counted_ptr() noexcept { }
+    counted_ptr(std::nullptr_t) noexcept { }
+
+    counted_ptr(const counted_ptr &other) noexcept : std::shared_ptr<T>(other) { count_copy(); }
+    counted_ptr(counted_ptr &&other) noexcept : std::shared_ptr<T>(std::move(other)) { }
+    template <class U, class = if_convertible<U>>
+    counted_ptr(const std::shared_ptr<U> &other) noexcept : std::shared_ptr<T>(other) { count_copy(); }
+    template <class U, class = if_convertible<U>>
+    counted_ptr(std::shared_ptr<U> &&other) noexcept : std::shared_ptr<T>(std::move(other)) { }
+
+    counted_ptr &operator=(const counted_ptr &other) noexcept {
+        std::shared_ptr<T>::operator=(other);
+        count_copy();
+        return *this;
+    }
+    counted_ptr &operator=(counted_ptr &&other) noexcept {
+        std::shared_ptr<T>::operator=(std::move(other));
+        return *this;
+    }
+
+private:
+    void count_copy() const noexcept {
+        if (Stats::enabled && *this)
+            class_stats<T>().copies.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Shares no ownership, so copying it touches no counts
+template <class T>
+counted_ptr<T> local_ptr(T *p) noexcept {
+    return std::shared_ptr<T>(std::shared_ptr<T>(), p);
+}
+
+template <class T, class... Args>
+counted_ptr<T> counted_new(Args &&... args) {
+    return std::allocate_shared<T>(CountingAllocator<T, T>(), std::forward<Args>(args)...);
+}
 
 #endif
 
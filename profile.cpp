@@ -0,0 +1,166 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include <cxxabi.h>
+
+#include "expr.hpp"
+#include "cont.hpp"
+
+bool Profile::enabled = false;
+bool Profile::count_allocations = false;
+
+static thread_local unsigned long allocations = 0;
+
+unsigned long Profile::allocations() {
+    return ::allocations;
+}
+
+void Profile::note_allocation() {
+    ::allocations++;
+}
+
+struct NodeStats {
+    PTR(Expr) expr;         // keeps the node alive for the report
+    std::string label;      // for continuations, which have no text
+    unsigned long count = 0;
+    long long inclusive_ns = 0;
+    long long exclusive_ns = 0;
+    unsigned long allocations = 0;
+    int active = 0;         // evaluations of this node in progress
+};
+
+// An evaluation in progress
+struct Frame {
+    NodeStats *stats;
+    long long start_ns;
+    long long child_ns;
+    unsigned long start_allocations;
+    unsigned long child_allocations;
+};
+
+struct ProfileState {
+    std::unordered_map<void *, NodeStats> nodes;
+    std::vector<Frame> frames;
+};
+
+static thread_local ProfileState state;
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static NodeStats *stats_for(PTR(Expr) e) {
+    NodeStats &stats = state.nodes[RAW(e)];
+    if (stats.expr == nullptr && stats.label.empty())
+        stats.expr = e;
+    return &stats;
+}
+
+static NodeStats *stats_for(Cont *c) {
+    // All continuations of one kind share a row
+    const std::type_info &type = typeid(*c);
+    NodeStats &stats = state.nodes[(void *)&type];
+    if (stats.label.empty()) {
+        int status;
+        char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+        stats.label = "<" + std::string(status == 0 ? name : type.name()) + ">";
+        std::free(name);
+    }
+    return &stats;
+}
+
+// Times the evaluation of one node, including when it throws
+class Timed {
+public:
+    Timed(NodeStats *stats) {
+        stats->count++;
+        stats->active++;
+        state.frames.push_back({stats, now_ns(), 0, allocations, 0});
+    }
+
+    ~Timed() {
+        Frame frame = state.frames.back();
+        state.frames.pop_back();
+        long long inclusive = now_ns() - frame.start_ns;
+        unsigned long allocated = allocations - frame.start_allocations;
+
+        NodeStats *stats = frame.stats;
+        stats->active--;
+        // A recursive node's inner evaluations are already part of
+        // its outermost one
+        if (stats->active == 0)
+            stats->inclusive_ns += inclusive;
+        stats->exclusive_ns += inclusive - frame.child_ns;
+        stats->allocations += allocated - frame.child_allocations;
+
+        if (!state.frames.empty()) {
+            state.frames.back().child_ns += inclusive;
+            state.frames.back().child_allocations += allocated;
+        }
+    }
+};
+
+PTR(Val) Profile::interp(PTR(Expr) e, PTR(Env) env) {
+    Timed timed(stats_for(e));
+    return e->interp_node(env);
+}
+
+void Profile::step_interp(PTR(Expr) e) {
+    Timed timed(stats_for(e));
+    e->step_interp();
+}
+
+void Profile::step_continue(PTR(Cont) c) {
+    Timed timed(stats_for(RAW(c)));
+    c->step_continue();
+}
+
+void Profile::report(std::ostream &out, size_t rows) {
+    std::vector<NodeStats *> ranked;
+    unsigned long evaluations = 0;
+    long long total_ns = 0;
+    for (auto &entry : state.nodes) {
+        ranked.push_back(&entry.second);
+        evaluations += entry.second.count;
+        total_ns += entry.second.exclusive_ns;
+    }
+    std::sort(ranked.begin(), ranked.end(), [](NodeStats *a, NodeStats *b) {
+        return a->exclusive_ns > b->exclusive_ns;
+    });
+    if (ranked.size() > rows)
+        ranked.resize(rows);
+
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "profile: " << evaluations << " evaluations of " << state.nodes.size()
+        << " nodes, " << total_ns / 1e6 << " ms\n";
+    out << std::setw(10) << "count" << std::setw(12) << "incl ms" << std::setw(12) << "excl ms"
+        << std::setw(8) << "excl %" << std::setw(10) << "allocs" << "  node\n";
+    for (NodeStats *stats : ranked) {
+        std::string text = stats->expr != nullptr ? stats->expr->to_string() : stats->label;
+        if (text.size() > 60)
+            text = text.substr(0, 57) + "...";
+        out << std::setw(10) << stats->count
+            << std::setw(12) << stats->inclusive_ns / 1e6
+            << std::setw(12) << stats->exclusive_ns / 1e6
+            << std::setprecision(1)
+            << std::setw(8) << (total_ns > 0 ? 100.0 * stats->exclusive_ns / total_ns : 0.0)
+            << std::setprecision(3)
+            << std::setw(10) << stats->allocations
+            << "  " << text << "\n";
+    }
+    out.flags(flags);
+}
+
+void Profile::clear() {
+    state.nodes.clear();
+    state.frames.clear();
+}
@@ -0,0 +1,50 @@
+#ifndef profile_hpp
+#define profile_hpp
+
+#include <iostream>
+
+#include "pointer.hpp"
+
+class Expr;
+class Env;
+class Val;
+class Cont;
+
+// Per-node execution profile, turned on with --profile. Every
+// evaluation of an expression is charged to its node: how many times
+// it ran, its time including and excluding the nodes it evaluated,
+// and the heap allocations made meanwhile. In interp_by_steps each
+// step is charged to the node it interprets or to the kind of
+// continuation it runs.
+//
+// When the profile is off, the only cost is a test of a flag for
+// each node evaluated, step taken and allocation made. Each thread
+// keeps its own profile.
+class Profile {
+public:
+    static bool enabled;
+    // Whether to count heap allocations, which the profile needs
+    static bool count_allocations;
+
+    // Heap allocations this thread has made while counting. Only a
+    // program linked with allocations.cpp, whose operator new calls
+    // `note_allocation`, counts any: the library leaves the allocator
+    // of a program that embeds it alone.
+    static unsigned long allocations();
+    static void note_allocation();
+
+    // Evaluates `e` in `env`, charging it to `e`
+    static PTR(Val) interp(PTR(Expr) e, PTR(Env) env);
+    // Take one step of the Step machine, charging it
+    static void step_interp(PTR(Expr) e);
+    static void step_continue(PTR(Cont) c);
+
+    // Prints the `rows` nodes with the most exclusive time,
+    // most expensive first
+    static void report(std::ostream &out, size_t rows = 20);
+
+    // Forgets this thread's profile
+    static void clear();
+};
+
+#endif /* profile_hpp */
@@ -0,0 +1,189 @@
+#include "random_expr.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+// Variables bound by the enclosing `_let`s and `_fun`s, and
+// functions that can be called there
+static std::vector<std::string> bound_vars;
+static std::vector<std::string> bound_funs;
+
+// Whether to generate random_program's forms, and whether we're
+// inside a `_fun`, where calls aren't allowed
+static bool any_form = false;
+static int fun_depth = 0;
+
+static std::string random_addend(int nested);
+static std::string random_inner(int nested);
+static std::string random_number();
+static std::string random_variable();
+static std::string random_let(int nested);
+static std::string random_call(int nested);
+static std::string random_other_inner(int nested);
+static std::string random_fun(int nested, int &arity);
+static std::string random_args(int nested, int arity);
+
+// generate random test
+std::string random_expr(int nested) {
+    if (nested == 0) return "0";
+    // random_program keeps sums and products short, since one
+    // boolean or function in them is enough to fail
+    int number_of_addend = any_form ? (rand() % 2) + 1 : (rand() % 5) + 1;
+    std::string expr = "";
+    for (int i = 0; i < number_of_addend; i++) {
+        expr += random_addend(nested);
+        if (i != number_of_addend - 1) expr += " + ";
+    }
+    if (any_form && rand() % 4 == 0)
+        expr += " == " + random_expr(nested - 1);
+    return expr;
+}
+
+static std::string random_addend(int nested) {
+    if (nested == 0) return "0";
+    int number_of_inner = any_form ? (rand() % 2) + 1 : (rand() % 5) + 1;
+    std::string addend = "";
+    for (int i = 0; i < number_of_inner; i++) {
+        addend += random_inner(nested);
+        if (i != number_of_inner - 1) addend += " * ";
+    }
+    return addend;
+}
+
+static std::string random_inner(int nested) {
+    if (nested == 0) return "0";
+    if (any_form && rand() % 3 == 0) return random_other_inner(nested);
+    int type_of_inner = ((rand() % 5) + 1);     // 1 to 5
+    if (type_of_inner == 1) return random_number();
+    else if (type_of_inner == 2) return random_variable();
+    else if (type_of_inner == 3) return "(" + random_expr(nested - 1) + ")";
+    else if (type_of_inner == 4) return random_let(nested);
+    else if (type_of_inner == 5) return random_call(nested);
+    return "";
+}
+
+// generate a random number ranging from 0 to 99, or for
+// random_program, sometimes one at the edge of 64 bits, so that
+// arithmetic on it overflows into a bignum
+static std::string random_number() {
+    static const char *edges[] = {
+        "9223372036854775807", "-9223372036854775808", "4294967296", "-1",
+        "99999999999999999999",
+    };
+    if (any_form && rand() % 8 == 0)
+        return edges[rand() % (sizeof(edges) / sizeof(edges[0]))];
+    return std::to_string(rand()%100);
+}
+
+// pick one of the variables in scope, or a number if there are none
+static std::string random_variable() {
+    if (bound_vars.empty())
+        return random_number();
+    return bound_vars[rand() % bound_vars.size()];
+}
+
+static std::string random_let(int nested) {
+    // one lowercase letter, which can't shadow a function
+    std::string var(1, (char) ((rand() % 26) + 'a'));
+    std::string rhs = random_expr(nested - 1);
+    bound_vars.push_back(var);
+    std::string body = random_expr(nested - 1);
+    bound_vars.pop_back();
+    return "_let " + var + " = " + rhs + " _in " + body;
+}
+
+// call one of the functions in scope, or a number if there are none
+static std::string random_call(int nested) {
+    if (bound_funs.empty())
+        return random_number();
+    return bound_funs[rand() % bound_funs.size()] + "(" + random_expr(nested - 1) + ")";
+}
+
+std::string random_fun_program(int nested) {
+    static const char *names[] = {"fa", "fb", "fc", "fd"};
+    int number_of_funs = (rand() % 4) + 1;   // 1 to 4
+
+    std::vector<std::string> outer_vars;
+    outer_vars.swap(bound_vars);
+    std::string program = "";
+    for (int i = 0; i < number_of_funs; i++) {
+        bound_vars.push_back("x");
+        std::string body = random_expr(nested);
+        bound_vars.pop_back();
+        program += "_let " + std::string(names[i]) + " = _fun (x) " + body + " _in ";
+        bound_funs.push_back(names[i]);
+    }
+    program += random_expr(nested);
+    bound_funs.clear();
+    bound_vars.swap(outer_vars);
+    return program;
+}
+
+std::string random_recursive_program(int depth) {
+    std::string step = std::to_string((rand() % 9) + 1);
+    switch (rand() % 3) {
+        case 0:     // step * depth
+            return "_let count = _fun (count) _fun (n) _if n == 0 _then 0 _else "
+                + step + " + count(count)(n + -1) _in count(count)(" + std::to_string(depth) + ")";
+        case 1:     // step * (1 + 2 + ... + depth), which nests its own _let
+            return "_let sum = _fun (sum) _fun (n) _if n == 0 _then 0 _else "
+                "_let rest = sum(sum)(n + -1) _in n * " + step + " + rest _in sum(sum)("
+                + std::to_string(depth) + ")";
+        default: {  // fibonacci, which is exponential, so it stays shallow
+            int n = depth < 16 ? depth : 16;
+            return "_let fib = _fun (fib) _fun (x) _if x == 0 _then 1 _else _if x == 1 _then 1 "
+                "_else fib(fib)(x + -1) + fib(fib)(x + -2) _in fib(fib)(" + std::to_string(n) + ")";
+        }
+    }
+}
+
+// the forms that only random_program uses
+static std::string random_other_inner(int nested) {
+    int type_of_inner = ((rand() % 4) + 1);     // 1 to 4
+    if (type_of_inner == 1) return rand() % 2 ? "_true" : "_false";
+    else if (type_of_inner == 2)
+        return "(_if " + random_expr(nested - 1) + " _then " + random_expr(nested - 1)
+            + " _else " + random_expr(nested - 1) + ")";
+    int arity;
+    if (type_of_inner == 3) return "(" + random_fun(nested, arity) + ")";
+    else if (type_of_inner == 4 && fun_depth == 0) {
+        // a variable, which may hold a function of any arity, or a
+        // `_fun` literal, called with the right number of arguments
+        if (rand() % 2 && !bound_vars.empty())
+            return random_variable() + random_args(nested, (rand() % 3) + 1);
+        std::string callee = "(" + random_fun(nested, arity) + ")";
+        return callee + random_args(nested, arity);
+    }
+    return random_number();
+}
+
+// `_fun` with one to three parameters, setting `arity` to how many
+static std::string random_fun(int nested, int &arity) {
+    arity = (rand() % 3) + 1;
+    std::string params;
+    for (int i = 0; i < arity; i++) {
+        // distinct letters, which may still shadow enclosing ones
+        std::string var(1, (char) ((rand() % 8) + i * 8 + 'a'));
+        params += (i == 0 ? "" : ", ") + var;
+        bound_vars.push_back(var);
+    }
+    fun_depth++;
+    std::string body = random_expr(nested - 1);
+    fun_depth--;
+    bound_vars.resize(bound_vars.size() - arity);
+    return "_fun (" + params + ") " + body;
+}
+
+static std::string random_args(int nested, int arity) {
+    std::string args = "(";
+    for (int i = 0; i < arity; i++)
+        args += (i == 0 ? "" : ", ") + random_expr(nested - 1);
+    return args + ")";
+}
+
+std::string random_program(int nested) {
+    any_form = true;
+    std::string program = random_expr(nested);
+    any_form = false;
+    return program;
+}
@@ -0,0 +1,31 @@
+#ifndef random_expr_hpp
+#define random_expr_hpp
+
+#include <string>
+
+// Random msdscript programs, for benchmarks and tests. Everything is
+// drawn from rand(), so srand() chooses the programs. Variables are
+// only used inside a `_let` that binds them, so every program
+// evaluates without error.
+
+// Sums of products of numbers, variables, parenthesized
+// subexpressions and `_let`s, nested up to `nested` deep
+std::string random_expr(int nested);
+
+// Defines a few one-argument functions with `_let` and then calls
+// them, from each other and from a random_expr-style body
+std::string random_fun_program(int nested);
+
+// A recursive function, written with self-application, that
+// recurses about `depth` times
+std::string random_recursive_program(int depth);
+
+// Like random_expr, but also with booleans, `==`, `_if`, `_fun`s of
+// up to three parameters and calls, and with variables bound to any
+// kind of value, and with some numbers at the edge of 64 bits. So it
+// can fail, by adding a boolean or calling a number with the wrong
+// number of arguments, for example. It still always terminates,
+// because no `_fun` body makes a call.
+std::string random_program(int nested);
+
+#endif /* random_expr_hpp */
@@ -0,0 +1,172 @@
+#include "scheduler.hpp"
+
+#include <stdexcept>
+
+#include "expr.hpp"
+#include "value.hpp"
+
+PTR(Val) Task::wait() {
+#if !PTR_THREAD_SAFE
+    while (!finished())
+        scheduler->take_turn();
+#endif
+    std::unique_lock<std::mutex> hold(lock);
+    finished_changed.wait(hold, [this] { return is_finished; });
+    if (failed)
+        throw std::runtime_error(error);
+    return result;
+}
+
+bool Task::finished() {
+    std::lock_guard<std::mutex> hold(lock);
+    return is_finished;
+}
+
+//==============================================================
+
+Scheduler::Scheduler(int threads, long _quantum)
+    : quantum(_quantum), next_worker(0), queued(0) {
+    if (threads < 1)
+        threads = 1;
+    for (int i = 0; i < threads; i++)
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+#if PTR_THREAD_SAFE
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->thread = std::thread(&Scheduler::work, this, i);
+#endif
+}
+
+Scheduler::~Scheduler() {
+    wait_all();
+    {
+        std::lock_guard<std::mutex> hold(idle_lock);
+        stopping = true;
+    }
+    work_queued.notify_all();
+    for (std::unique_ptr<Worker> &worker : workers)
+        if (worker->thread.joinable())
+            worker->thread.join();
+}
+
+PTR(Task) Scheduler::spawn(PTR(Expr) e) {
+    PTR(Task) task = NEW(Task)();
+    task->scheduler = this;
+    task->state = Step::start(e);
+    {
+        std::lock_guard<std::mutex> hold(unfinished_lock);
+        unfinished++;
+    }
+#if PTR_THREAD_SAFE
+    push(next_worker++ % workers.size(), task, true);
+#else
+    // counts in the objects a task shares with others aren't atomic,
+    // so it waits to be run on the thread that waits for it
+    push(0, task, false);
+#endif
+    return task;
+}
+
+void Scheduler::wait_all() {
+#if !PTR_THREAD_SAFE
+    while (take_turn()) { }
+#endif
+    std::unique_lock<std::mutex> hold(unfinished_lock);
+    all_finished.wait(hold, [this] { return unfinished == 0; });
+}
+
+// Queues `task` for worker `index`, waking a sleeping worker if
+// `wake` says there's work for it
+void Scheduler::push(size_t index, PTR(Task) task, bool wake) {
+    {
+        std::lock_guard<std::mutex> hold(workers[index]->lock);
+        workers[index]->tasks.push_back(task);
+        // one task is only worth stealing from a worker that is busy
+        wake = wake || workers[index]->tasks.size() > 1;
+    }
+    queued++;
+    if (!wake)
+        return;
+    // taking the lock means a worker can't miss this between checking
+    // `queued` and going to sleep
+    std::lock_guard<std::mutex> hold(idle_lock);
+    work_queued.notify_one();
+}
+
+// The next task for worker `index`: its own oldest, or else another
+// worker's newest
+PTR(Task) Scheduler::take(size_t index) {
+    for (size_t i = 0; i < workers.size(); i++) {
+        Worker &worker = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> hold(worker.lock);
+        if (worker.tasks.empty())
+            continue;
+        PTR(Task) task;
+        if (i == 0) {
+            task = worker.tasks.front();
+            worker.tasks.pop_front();
+        } else {
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
+        }
+        queued--;
+        return task;
+    }
+    return nullptr;
+}
+
+void Scheduler::work(size_t index) {
+    while (1) {
+        PTR(Task) task = take(index);
+        if (task == nullptr) {
+            std::unique_lock<std::mutex> hold(idle_lock);
+            work_queued.wait(hold, [this] { return stopping || queued > 0; });
+            if (stopping)
+                return;
+            continue;
+        }
+
+        if (!run(task))
+            push(index, task, false);
+    }
+}
+
+// Runs the first queued task for a quantum on this thread, queueing
+// it again behind the others if it hasn't finished. Returns false if
+// there was none.
+bool Scheduler::take_turn() {
+    PTR(Task) task = take(0);
+    if (task == nullptr)
+        return false;
+    if (!run(task))
+        push(0, task, false);
+    return true;
+}
+
+// Runs `task` for a quantum, returning true if it finished
+bool Scheduler::run(PTR(Task) task) {
+    try {
+        if (!Step::run(task->state, quantum))
+            return false;
+        task->result = task->state.val;
+    } catch (std::exception &e) {
+        task->failed = true;
+        task->error = e.what();
+    }
+    finish(task);
+    return true;
+}
+
+void Scheduler::finish(PTR(Task) task) {
+    // let go of the machine, whose environment and continuations
+    // can be large
+    task->state = StepState();
+    {
+        std::lock_guard<std::mutex> hold(task->lock);
+        task->is_finished = true;
+    }
+    task->finished_changed.notify_all();
+
+    std::lock_guard<std::mutex> hold(unfinished_lock);
+    if (--unfinished == 0)
+        all_finished.notify_all();
+}
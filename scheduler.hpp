@@ -0,0 +1,94 @@
+#ifndef scheduler_hpp
+#define scheduler_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pointer.hpp"
+#include "step.hpp"
+
+class Expr;
+class Val;
+class Scheduler;
+
+// One evaluation run by a Scheduler: a Step machine and, once it
+// finishes, its value or error
+class Task REF_COUNTED {
+public:
+    // Waits for the task to finish, then returns its value, or throws
+    // `runtime_error` with the message it failed with
+    PTR(Val) wait();
+    bool finished();
+
+private:
+    friend class Scheduler;
+
+    Scheduler *scheduler;
+    StepState state;
+    std::mutex lock;
+    std::condition_variable finished_changed;
+    bool is_finished = false;
+    PTR(Val) result;
+    bool failed = false;
+    std::string error;
+};
+
+// Runs many Step machines as tasks on a fixed pool of threads. Each
+// thread takes turns among its tasks, running each for `quantum`
+// steps before suspending it at the back of its queue. A thread with
+// nothing to do steals from the back of another thread's queue.
+//
+// When PTR counts aren't atomic, no threads are started. The tasks
+// take turns in the same way on whichever thread waits for them, in
+// `Task::wait` or `wait_all`, so one that never finishes still can't
+// keep the others from running.
+class Scheduler {
+public:
+    Scheduler(int threads, long quantum = 1000);
+    // Waits for every task, then stops the threads
+    ~Scheduler();
+
+    // Starts evaluating `e`
+    PTR(Task) spawn(PTR(Expr) e);
+    // Waits until every task spawned so far has finished
+    void wait_all();
+
+private:
+    // which takes turns while it waits, when there are no threads
+    friend class Task;
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<PTR(Task)> tasks;
+        std::thread thread;
+    };
+
+    long quantum;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<unsigned> next_worker;
+
+    // Workers without tasks sleep until one is queued
+    std::mutex idle_lock;
+    std::condition_variable work_queued;
+    std::atomic<long> queued;
+    bool stopping = false;
+
+    std::mutex unfinished_lock;
+    std::condition_variable all_finished;
+    long unfinished = 0;
+
+    void work(size_t index);
+    bool take_turn();
+    bool run(PTR(Task) task);
+    PTR(Task) take(size_t index);
+    void push(size_t index, PTR(Task) task, bool wake);
+    void finish(PTR(Task) task);
+};
+
+#endif /* scheduler_hpp */
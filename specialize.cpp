@@ -0,0 +1,239 @@
+#include "specialize.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "expr.hpp"
+#include "value.hpp"
+#include "env.hpp"
+
+// The result of specializing an expression: the residual expression,
+// and its value when that is known without evaluating anything. A
+// known value is a NumVal or BoolVal, whose residual is its literal,
+// or a FunVal with an empty environment and a closed body, whose
+// residual is that closed `_fun`. Since every known value has a closed
+// residual, it can be put anywhere without capturing anything.
+struct Residual {
+    PTR(Expr) expr;
+    PTR(Val) val;
+};
+
+// While specializing, the environment maps each variable in scope
+// either to its known value or, for a variable that stays in the
+// residual program, to nullptr. Returns nullptr for both unknown and
+// unbound variables.
+static PTR(Val) known_value(PTR(Env) env, const std::string &name) {
+    PTR(ExtendedEnv) ext = CAST(ExtendedEnv)(env);
+    while (ext != NULL) {
+        if (ext->name == name)
+            return ext->val;
+        ext = CAST(ExtendedEnv)(ext->rest);
+    }
+    return NULL;
+}
+
+static bool is_literal_val(PTR(Val) val) {
+    return CAST(NumVal)(val) != NULL || CAST(BoolVal)(val) != NULL;
+}
+
+static Residual known(PTR(Val) val) {
+    return {val->to_expr(), val};
+}
+
+// Calls are only inlined when `inline_calls` is set, which is when
+// the program would certainly make the call: not inside a `_fun` body
+// or an `_if` branch that stays in the residual program. Unrolling
+// recursion there would never stop.
+static Residual spec(PTR(Expr) e, PTR(Env) env, int &fuel, bool inline_calls);
+
+// Specializes a body with `var` bound to `rhs`, keeping the binding in
+// the residual program only if the residual body still refers to it
+// or the rhs has to be evaluated anyway. `spec_body` specializes the
+// body in the environment it's given.
+template<typename SpecBody>
+static Residual spec_let(std::string var, int var_sym, Residual rhs, PTR(Env) env, SpecBody spec_body) {
+    if (rhs.val != nullptr)
+        return spec_body(NEW(ExtendedEnv)(env, var, var_sym, rhs.val));
+
+    Residual new_body = spec_body(NEW(ExtendedEnv)(env, var, var_sym, nullptr));
+    if (!new_body.expr->free_vars.contains(var_sym) && rhs.expr->pure)
+        return new_body;
+    return {NEW(LetExpr)(var, var_sym, rhs.expr, new_body.expr), nullptr};
+}
+
+// Specializes `body` with the parameters from `i` on bound to `args`,
+// as nested `_let`s
+static Residual spec_args(PTR(ParamList) params, size_t i, const std::vector<Residual> &args,
+                          PTR(Expr) body, PTR(Env) env, int &fuel, bool inline_calls) {
+    if (i == args.size())
+        return spec(body, env, fuel, inline_calls);
+    return spec_let(params->names[i], params->syms[i], args[i], env, [&](PTR(Env) body_env) {
+        return spec_args(params, i + 1, args, body, body_env, fuel, inline_calls);
+    });
+}
+
+static Residual spec_fun(PTR(ParamList) params, PTR(Expr) body, PTR(Env) env, int &fuel) {
+    for (size_t i = 0; i < params->names.size(); i++)
+        env = NEW(ExtendedEnv)(env, params->names[i], params->syms[i], nullptr);
+    PTR(Expr) new_body = spec(body, env, fuel, false).expr;
+    PTR(Expr) fun = NEW(FunExpr)(params, new_body);
+    if (fun->containsVar())
+        return {fun, nullptr};
+    return {fun, NEW(FunVal)(params, new_body, Env::empty)};
+}
+
+static Residual spec(PTR(Expr) e, PTR(Env) env, int &fuel, bool inline_calls) {
+    if (CAST(NumExpr)(e) != NULL || CAST(BoolExpr)(e) != NULL)
+        return {e, e->interp(Env::empty)};
+
+    if (PTR(VarExpr) v = CAST(VarExpr)(e)) {
+        PTR(Val) val = known_value(env, v->name);
+        if (val != nullptr)
+            return known(val);
+        return {e, nullptr};
+    }
+
+    if (PTR(AddExpr) a = CAST(AddExpr)(e)) {
+        Residual lhs = spec(a->lhs, env, fuel, inline_calls);
+        Residual rhs = spec(a->rhs, env, fuel, inline_calls);
+        if (CAST(NumVal)(lhs.val) != NULL && CAST(NumVal)(rhs.val) != NULL) {
+            return known(lhs.val->add_to(rhs.val));
+        }
+        return {NEW(AddExpr)(lhs.expr, rhs.expr), nullptr};
+    }
+
+    if (PTR(MultExpr) m = CAST(MultExpr)(e)) {
+        Residual lhs = spec(m->lhs, env, fuel, inline_calls);
+        Residual rhs = spec(m->rhs, env, fuel, inline_calls);
+        if (CAST(NumVal)(lhs.val) != NULL && CAST(NumVal)(rhs.val) != NULL) {
+            return known(lhs.val->mult_with(rhs.val));
+        }
+        return {NEW(MultExpr)(lhs.expr, rhs.expr), nullptr};
+    }
+
+    if (PTR(CompareExpr) c = CAST(CompareExpr)(e)) {
+        Residual lhs = spec(c->lhs, env, fuel, inline_calls);
+        Residual rhs = spec(c->rhs, env, fuel, inline_calls);
+        // functions compare by their body, which specializing changes
+        if (is_literal_val(lhs.val) && is_literal_val(rhs.val)) {
+            return known(NEW(BoolVal)(lhs.val->equals(rhs.val)));
+        }
+        return {NEW(CompareExpr)(lhs.expr, rhs.expr), nullptr};
+    }
+
+    if (PTR(IfExpr) i = CAST(IfExpr)(e)) {
+        Residual condition = spec(i->condition, env, fuel, inline_calls);
+        if (condition.val != NULL)
+            return spec(condition.val->is_true() ? i->then_part : i->else_part, env, fuel, inline_calls);
+        return {NEW(IfExpr)(condition.expr,
+                            spec(i->then_part, env, fuel, false).expr,
+                            spec(i->else_part, env, fuel, false).expr), nullptr};
+    }
+
+    if (PTR(LetExpr) l = CAST(LetExpr)(e)) {
+        Residual rhs = spec(l->rhs, env, fuel, inline_calls);
+        return spec_let(l->varStr, l->var_sym, rhs, env, [&](PTR(Env) body_env) {
+            return spec(l->body, body_env, fuel, inline_calls);
+        });
+    }
+
+    if (PTR(FunExpr) f = CAST(FunExpr)(e))
+        return spec_fun(f->params, f->body, env, fuel);
+
+    if (PTR(CallExpr) c = CAST(CallExpr)(e)) {
+        Residual callee = spec(c->to_be_called, env, fuel, inline_calls);
+        std::vector<Residual> args;
+        std::vector<PTR(Expr)> arg_exprs;
+        bool args_known = true;
+        for (PTR(Expr) const &actual_arg : c->actual_args) {
+            args.push_back(spec(actual_arg, env, fuel, inline_calls));
+            arg_exprs.push_back(args.back().expr);
+            args_known = args_known && args.back().val != NULL;
+        }
+        PTR(FunVal) fun = CAST(FunVal)(callee.val);
+        if (inline_calls && fun != NULL && args_known && fuel > 0
+            && fun->params->names.size() == args.size()) {
+            fuel--;
+            // The callee is closed, so its body can go right here
+            // as a `_let` of each argument. They're all known, so
+            // none of them refers to a parameter bound before it.
+            return spec_args(fun->params, 0, args, fun->body, Env::empty, fuel, inline_calls);
+        }
+        return {NEW(CallExpr)(callee.expr, arg_exprs), nullptr};
+    }
+
+    throw std::runtime_error("specialize: unknown expression " + e->to_string());
+}
+
+typedef std::vector<std::pair<std::string, PTR(Expr)>> Bindings;
+
+// Wraps `body` in a `_let` for each of `lets` that it refers to,
+// innermost last, leaving out `skip`, which `body` binds itself.
+static PTR(Expr) wrap_lets(const Bindings &lets, PTR(Expr) body, const VarSet &skip) {
+    for (auto it = lets.rbegin(); it != lets.rend(); ++it) {
+        int sym = Symbol::intern(it->first);
+        if (!skip.contains(sym) && body->free_vars.contains(sym))
+            body = NEW(LetExpr)(it->first, it->second, body);
+    }
+    return body;
+}
+
+static PTR(Env) close_env(PTR(Env) runtime, Bindings &lets, int &fuel);
+
+// Specializes a closure from a runtime environment into a `_fun`
+// that carries the functions it captured as `_let`s in its body.
+static Residual close_fun(PTR(FunVal) f, int &fuel) {
+    Bindings lets;
+    PTR(Env) env = close_env(f->env, lets, fuel);
+    Residual fun = spec_fun(f->params, f->body, env, fuel);
+    PTR(FunExpr) fun_expr = CAST(FunExpr)(fun.expr);
+    VarSet params;
+    for (int sym : f->params->syms)
+        params.add(sym);
+    PTR(Expr) body = wrap_lets(lets, fun_expr->body, params);
+    PTR(Expr) closed = NEW(FunExpr)(f->params, body);
+    if (closed->containsVar())
+        return {closed, nullptr};
+    return {closed, NEW(FunVal)(f->params, body, Env::empty)};
+}
+
+// Turns an environment of runtime values into one for `spec`. Each
+// function in it is specialized into a closed `_fun`. One that can't
+// be closed because it refers to an unbound variable is added to
+// `lets` instead, which the caller must bind around any residual code
+// that refers to it.
+static PTR(Env) close_env(PTR(Env) runtime, Bindings &lets, int &fuel) {
+    // innermost first, ending with what a closure captured
+    std::vector<std::pair<std::string, PTR(Val)>> frames;
+    PTR(Env) rest = runtime;
+    while (PTR(ExtendedEnv) ext = CAST(ExtendedEnv)(rest)) {
+        frames.push_back(std::make_pair(ext->name, ext->val));
+        rest = ext->rest;
+    }
+    if (PTR(ClosureEnv) closure = CAST(ClosureEnv)(rest)) {
+        for (size_t i = 0; i < closure->captures->names.size(); i++)
+            if (closure->val(i) != nullptr)
+                frames.push_back(std::make_pair(closure->captures->names[i], closure->val(i)));
+    }
+
+    PTR(Env) env = Env::empty;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+        PTR(Val) val = it->second;
+        if (PTR(FunVal) f = CAST(FunVal)(val)) {
+            Residual fun = close_fun(f, fuel);
+            if (fun.val == nullptr)
+                lets.push_back(std::make_pair(it->first, fun.expr));
+            val = fun.val;
+        }
+        env = NEW(ExtendedEnv)(env, it->first, val);
+    }
+    return env;
+}
+
+PTR(Expr) specialize(PTR(Expr) e, PTR(Env) known, int max_inlines) {
+    int fuel = max_inlines;
+    Bindings lets;
+    PTR(Env) env = close_env(known, lets, fuel);
+    return wrap_lets(lets, spec(e, env, fuel, true).expr, VarSet());
+}
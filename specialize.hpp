@@ -0,0 +1,21 @@
+#ifndef specialize_hpp
+#define specialize_hpp
+
+#include "pointer.hpp"
+
+class Expr;
+class Env;
+
+// Partially evaluates `e` given the values of some of its free
+// variables in `known`. Everything that depends only on known values
+// is folded: arithmetic, comparisons, `_let`s, `_if`s whose condition
+// becomes known, and calls of known functions on known arguments,
+// which are inlined. The result is a residual program over the
+// remaining free variables, which evaluates like `e` would in an
+// environment extending `known`.
+//
+// At most `max_inlines` calls are inlined, so specializing a program
+// that doesn't terminate still does.
+PTR(Expr) specialize(PTR(Expr) e, PTR(Env) known, int max_inlines = 1000);
+
+#endif /* specialize_hpp */
@@ -0,0 +1,86 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <string>
+
+bool Stats::enabled = false;
+
+static std::mutex classes_lock;
+
+// Never destroyed, since a static PTR freed at exit can count
+// against a class for the first time after static destructors run
+static std::vector<ClassStats *> &all_classes() {
+    static std::vector<ClassStats *> *classes = new std::vector<ClassStats *>;
+    return *classes;
+}
+
+ClassStats::ClassStats(const char *signature)
+    : allocations(0), bytes(0), frees(0), copies(0) {
+    // "ClassStats& class_stats() [with T = AddExpr]" from gcc,
+    // "ClassStats &class_stats() [T = AddExpr]" from clang
+    name = signature;
+    size_t start = name.find("T = ");
+    if (start != std::string::npos) {
+        name = name.substr(start + 4);
+        name = name.substr(0, name.find_first_of(";]"));
+    }
+    std::lock_guard<std::mutex> hold(classes_lock);
+    all_classes().push_back(this);
+}
+
+std::vector<ClassStats *> Stats::classes() {
+    std::lock_guard<std::mutex> hold(classes_lock);
+    return all_classes();
+}
+
+unsigned long Stats::allocations() {
+    unsigned long total = 0;
+    for (ClassStats *stats : classes())
+        total += stats->allocations;
+    return total;
+}
+
+unsigned long Stats::bytes() {
+    unsigned long total = 0;
+    for (ClassStats *stats : classes())
+        total += stats->bytes;
+    return total;
+}
+
+unsigned long Stats::copies() {
+    unsigned long total = 0;
+    for (ClassStats *stats : classes())
+        total += stats->copies;
+    return total;
+}
+
+void Stats::report(std::ostream &out) {
+    std::vector<ClassStats *> ranked = classes();
+    std::sort(ranked.begin(), ranked.end(), [](ClassStats *a, ClassStats *b) {
+        return a->allocations > b->allocations
+            || (a->allocations == b->allocations && a->copies > b->copies);
+    });
+    out << "stats: " << allocations() << " allocations, " << bytes() << " bytes, "
+        << copies() << " shared_ptr copies\n";
+    out << std::setw(12) << "allocs" << std::setw(12) << "bytes" << std::setw(12) << "frees"
+        << std::setw(12) << "copies" << "  class\n";
+    for (ClassStats *stats : ranked) {
+        if (stats->allocations == 0 && stats->copies == 0)
+            continue;
+        out << std::setw(12) << stats->allocations << std::setw(12) << stats->bytes
+            << std::setw(12) << stats->frees << std::setw(12) << stats->copies
+            << "  " << stats->name << "\n";
+    }
+}
+
+void Stats::reset() {
+    for (ClassStats *stats : classes()) {
+        stats->allocations = 0;
+        stats->bytes = 0;
+        stats->frees = 0;
+        stats->copies = 0;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef stats_hpp
+#define stats_hpp
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Allocation and reference-count counters by class, turned on with
+// --stats. NEW counts each object it allocates against the object's
+// class, including its shared_ptr control block, and PTR counts each
+// copy against the class it points to as. Moves aren't copies, since
+// they don't touch the reference count.
+struct ClassStats {
+    std::string name;
+    std::atomic<unsigned long> allocations;
+    std::atomic<unsigned long> bytes;
+    std::atomic<unsigned long> frees;
+    std::atomic<unsigned long> copies;
+
+    // Takes the class name from the signature of class_stats<T>, since
+    // PTR is copied where T is incomplete and typeid can't be used
+    ClassStats(const char *signature);
+};
+
+class Stats {
+public:
+    static bool enabled;
+
+    // Every class that has been counted so far
+    static std::vector<ClassStats *> classes();
+    // The sums over all classes
+    static unsigned long allocations();
+    static unsigned long bytes();
+    static unsigned long copies();
+
+    // Prints one row per class, most allocated first
+    static void report(std::ostream &out);
+    static void reset();
+};
+
+// The counters of class `T`, created the first time they're needed
+template <class T>
+ClassStats &class_stats() {
+    static ClassStats stats(__PRETTY_FUNCTION__);
+    return stats;
+}
+
+#endif /* stats_hpp */
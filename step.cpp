@@ -7,44 +7,83 @@
 //
 
 #include "step.hpp"
+
+#include <chrono>
+
 #include "expr.hpp"
 #include "env.hpp"
+#include "value.hpp"
 #include "cont.hpp"
+#include "profile.hpp"
 
 
-Step::mode_t Step::mode;
-
-PTR(Cont) Step::cont;
+// How many steps to take between looks at the clock
+static const long steps_per_clock_check = 256;
 
-PTR(Expr) Step::expr; /* only for Step::interp_mode */
-PTR(Env) Step::env; /* only for Step::interp_mode */
 
-PTR(Val) Step::val;        /* only for Step::continue_mode */
+PTR(Val) Step::interp_by_steps(PTR(Expr) e) {
+    StepState state = start(e);
+    run(state, 0);
+    return state.val;
+}
 
+StepState Step::start(PTR(Expr) e) {
+    StepState state;
+    state.mode = Step::interp_mode;
+    state.expr = e;
+    state.env = Env::empty;
+    state.val = nullptr;
+    state.cont = Cont::done;
+    state.steps = 0;
+    return state;
+}
 
+bool Step::run(StepState &state, long max_steps, long max_micros) {
+    if (state.done())
+        return true;
 
+    // runs can nest, when evaluation starts another machine
+    struct Running {
+        StepState *outer;
+        Running(StepState *state) : outer(Step::machine) { Step::machine = state; }
+        ~Running() { Step::machine = outer; }
+    } running(&state);
 
+    std::chrono::steady_clock::time_point deadline;
+    if (max_micros > 0)
+        deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(max_micros);
 
-PTR(Val) Step::interp_by_steps(PTR(Expr) e) {
-    Step::mode = Step::interp_mode;
-    Step::val = nullptr;
-    Step::env = Env::empty;
-    Step::expr = e;
-    Step::cont = Cont::done;
-    
+    long steps = 0;
+    bool finished = false;
     while (1) {
-        if (Step::mode == interp_mode) {
-            Step::expr -> step_interp();
+        if (state.mode == interp_mode) {
+            if (Profile::enabled)
+                Profile::step_interp(state.expr);
+            else
+                state.expr -> step_interp();
         }
         else {
-            if (Step::cont == Cont::done) {
-                return Step::val;
+            if (state.cont == Cont::done) {
+                finished = true;
+                break;
+            } else if (Profile::enabled) {
+                Profile::step_continue(state.cont);
             } else {
-                Step::cont -> step_continue();
+                state.cont -> step_continue();
             }
         }
+        steps++;
+        if (max_steps > 0 && steps >= max_steps)
+            break;
+        if (max_micros > 0 && steps % steps_per_clock_check == 0
+            && std::chrono::steady_clock::now() >= deadline)
+            break;
     }
-}
-
 
+    state.steps += steps;
+    return finished;
+}
 
+bool StepState::done() {
+    return mode == Step::continue_mode && cont == Cont::done;
+}
@@ -13,6 +13,7 @@
 #include "pointer.hpp"
 #include <stdio.h>
 #include "expr.hpp"
+#include "cont.hpp"
 
 
 class Expr;
@@ -20,6 +21,8 @@ class Env;
 class Cont;
 class Val;
 
+class StepState;
+
 class Step {
 public:
     
@@ -28,17 +31,39 @@ public:
         continue_mode
     } mode_t;
     
-    static mode_t mode;       /* choose mode */
-
-    static PTR(Expr) expr;    /* for interp_mode */
-    static PTR(Env) env;      /* for interp_mode */
-    
-    static PTR(Val) val;      /* for continue_mode */
-    
-    static PTR(Cont) cont;    /* for all modes */
+    // The registers of the machine running on this thread, which
+    // are those of the StepState being run
+    static inline thread_local StepState *machine = nullptr;
     
     static PTR(Val) interp_by_steps(PTR(Expr) e);
     
+    // A machine ready to evaluate `e` with `run`
+    static StepState start(PTR(Expr) e);
+
+    // Continues `state` until it finishes, has taken `max_steps` more
+    // steps, or has run for `max_micros` microseconds, where 0 means
+    // no limit. Returns true once it has finished, with the result in
+    // `state.val`; otherwise `state` can be run again later, on any
+    // thread. Throws `runtime_error` if evaluation fails, after which
+    // `state` can't be resumed.
+    static bool run(StepState &state, long max_steps, long max_micros = 0);
+};
+
+// The registers of a Step machine, which keep its state between runs
+class StepState {
+public:
+    Step::mode_t mode;  /* choose mode */
+
+    PTR(Expr) expr;     /* for interp_mode */
+    PTR(Env) env;       /* for interp_mode */
+
+    PTR(Val) val;       /* for continue_mode */
+
+    PTR(Cont) cont;     /* for all modes */
+
+    long steps;         // taken so far
+
+    bool done();
 };
 
 #endif /* step_hpp */
@@ -0,0 +1,141 @@
+#include "symbol.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+// The table is shared by every thread that builds expressions.
+static std::mutex table_lock;
+static std::unordered_map<std::string, int> ids_by_name;
+static std::deque<std::string> names_by_id;
+// For each base given to `fresh`, the suffix to try next, so that
+// making many names from one base doesn't search from the start
+static std::unordered_map<std::string, int> next_suffix;
+
+int Symbol::intern(const std::string &name) {
+    std::lock_guard<std::mutex> guard(table_lock);
+    auto found = ids_by_name.find(name);
+    if (found != ids_by_name.end())
+        return found->second;
+    int id = (int)names_by_id.size();
+    names_by_id.push_back(name);
+    ids_by_name[name] = id;
+    return id;
+}
+
+std::string Symbol::name(int id) {
+    std::lock_guard<std::mutex> guard(table_lock);
+    return names_by_id.at(id);
+}
+
+// Letters for `n`: "a" to "z", then "ba" and so on
+static std::string suffix(int n) {
+    std::string s;
+    do {
+        s = (char)('a' + n % 26) + s;
+        n /= 26;
+    } while (n > 0);
+    return s;
+}
+
+std::string Symbol::fresh(const std::string &base) {
+    std::lock_guard<std::mutex> guard(table_lock);
+    for (int &n = next_suffix[base]; ; n++) {
+        std::string name = base + suffix(n);
+        if (ids_by_name.count(name) == 0) {
+            ids_by_name[name] = (int)names_by_id.size();
+            names_by_id.push_back(name);
+            n++;
+            return name;
+        }
+    }
+}
+
+std::string Symbol::fresh(const std::string &base, const VarSet &avoid) {
+    std::lock_guard<std::mutex> guard(table_lock);
+    // at most one candidate per member of `avoid` is rejected
+    for (int n = 0; ; n++) {
+        std::string name = base + suffix(n);
+        auto found = ids_by_name.find(name);
+        if (found == ids_by_name.end() || !avoid.contains(found->second))
+            return name;
+    }
+}
+
+//============================================================
+
+VarSet::VarSet() {
+    count = 0;
+}
+
+VarSet::VarSet(int id) {
+    count = 1;
+    first[0] = id;
+}
+
+bool VarSet::empty() const {
+    return count == 0;
+}
+
+bool VarSet::contains(int id) const {
+    return std::binary_search(members(), members() + count, id);
+}
+
+void VarSet::add(int id) {
+    add_all(VarSet(id));
+}
+
+void VarSet::remove(int id) {
+    const int *start = members();
+    const int *found = std::lower_bound(start, start + count, id);
+    if (found == start + count || *found != id)
+        return;
+    size_t at = found - start;
+    if (count <= inline_count) {
+        std::copy(first + at + 1, first + count, first + at);
+        count--;
+        return;
+    }
+    more.erase(more.begin() + at);
+    count--;
+    if (count == inline_count) {
+        std::copy(more.begin(), more.end(), first);
+        more.clear();
+    }
+}
+
+void VarSet::add_all(const VarSet &other) {
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    // the union of two inline sets is merged on the stack
+    int merged_inline[2 * inline_count];
+    std::vector<int> merged_big;
+    int *merged = merged_inline;
+    if (count + other.count > 2 * inline_count) {
+        merged_big.resize(count + other.count);
+        merged = merged_big.data();
+    }
+    int *end = std::set_union(members(), members() + count,
+                              other.members(), other.members() + other.count, merged);
+    assign(merged, end - merged);
+}
+
+std::vector<int> VarSet::ids() const {
+    return std::vector<int>(members(), members() + count);
+}
+
+// `ids` must not point into this set
+void VarSet::assign(const int *ids, size_t n) {
+    count = n;
+    if (n <= inline_count) {
+        std::copy(ids, ids + n, first);
+        more.clear();
+    } else {
+        more.assign(ids, ids + n);
+    }
+}
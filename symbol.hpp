@@ -0,0 +1,57 @@
+#ifndef symbol_hpp
+#define symbol_hpp
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class VarSet;
+
+// Variable names are interned once into small integer ids, so that
+// name checks are integer compares. Interning takes a lock, so it's
+// done when expressions are parsed or rewritten with new names, never
+// while they're evaluated.
+class Symbol {
+public:
+    static int intern(const std::string &name);
+    static std::string name(int id);
+
+    // A name that has not been interned yet, built from `base` plus
+    // letters so that it still parses as a variable, and then interned
+    static std::string fresh(const std::string &base);
+    // A name built the same way whose symbol isn't in `avoid`. It may
+    // have been interned already, for an earlier rename, and it isn't
+    // interned here, so renaming over and over reuses a few names
+    // instead of adding a new one to the table each time.
+    static std::string fresh(const std::string &base, const VarSet &avoid);
+};
+
+// A set of interned symbols, as their ids in increasing order. It
+// takes space only for its members, however many names have been
+// interned, and up to `inline_count` of them live inline, so the
+// free variables of most expressions never allocate.
+class VarSet {
+public:
+    VarSet();
+    explicit VarSet(int id);
+
+    bool empty() const;
+    bool contains(int id) const;
+    void add(int id);
+    void remove(int id);
+    void add_all(const VarSet &other);
+    std::vector<int> ids() const;
+
+private:
+    static const size_t inline_count = 3;
+    // the members are in `first` while there are at most
+    // `inline_count`, and all in `more` after that
+    size_t count;
+    int first[inline_count];
+    std::vector<int> more;
+
+    const int *members() const { return count <= inline_count ? first : more.data(); }
+    void assign(const int *ids, size_t n);
+};
+
+#endif /* symbol_hpp */
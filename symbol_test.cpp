@@ -0,0 +1,44 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "expr.hpp"
+#include "parse.hpp"
+#include "symbol.hpp"
+
+static PTR(Expr) parse_program(const std::string &source) {
+    std::istringstream in(source);
+    return parse(in);
+}
+
+// `source` with `y` substituted for `x`
+static std::string subst_y_for_x(const std::string &source) {
+    return parse_program(source)->subst(Symbol::intern("x"), NEW(VarExpr)("y"))->to_string();
+}
+
+TEST_CASE("Symbol::fresh gives a new name each time") {
+    std::string first = Symbol::fresh("fresh");
+    std::string second = Symbol::fresh("fresh");
+    CHECK(first != second);
+    CHECK(first.compare(0, 5, "fresh") == 0);
+    CHECK(second.compare(0, 5, "fresh") == 0);
+}
+
+TEST_CASE("subst renames a binder to a name it can reuse") {
+    // the same rename twice gives the same name
+    CHECK(subst_y_for_x("_fun (y) x + y") == "_fun (ya) y + ya");
+    CHECK(subst_y_for_x("_fun (y) x + y") == "_fun (ya) y + ya");
+    CHECK(subst_y_for_x("_let y = 2 _in x + y") == "_let ya = 2 _in y + ya");
+
+    // but never to a name that is free in the body, or is another
+    // parameter
+    CHECK(subst_y_for_x("_fun (y) x + y + ya") == "_fun (yb) y + yb + ya");
+    CHECK(subst_y_for_x("_fun (y, ya) x + y") == "_fun (yb, ya) y + yb");
+
+    // and the result still evaluates as substitution should
+    PTR(Expr) e = parse_program("(_fun (y) x + y)(1)")->subst(Symbol::intern("x"),
+                                                              parse_program("y * 10"));
+    e = parse_program("_let y = 4 _in " + e->to_string());
+    CHECK(e->interp(Env::empty)->to_string() == "41");
+}
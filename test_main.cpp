@@ -0,0 +1,6 @@
+// msdscript_test: the unit tests, which are in the *_test.cpp files
+// and run with ctest
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include "catch.hpp"
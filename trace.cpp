@@ -0,0 +1,181 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "expr.hpp"
+#include "value.hpp"
+#include "symbol.hpp"
+
+bool Trace::enabled = false;
+size_t Trace::capacity = 1 << 20;
+
+enum EventKind { begin_call_event, begin_let_event, end_event };
+
+struct Event {
+    EventKind kind;
+    int var;                // the `_let` variable, for begin_let_event
+    PTR(ParamList) params;  // the parameters, for begin_call_event
+    PTR(Expr) body;         // null for end_event
+    long long ts_ns;
+};
+
+struct TraceBuffer REF_COUNTED {
+    int tid;
+    std::vector<Event> events;  // a ring once it reaches capacity
+    size_t next = 0;            // where the next event goes
+    size_t dropped = 0;
+};
+
+// Every thread's buffer, so that write sees threads that have exited
+static std::mutex buffers_lock;
+static std::vector<PTR(TraceBuffer)> buffers;
+
+static TraceBuffer &this_thread_buffer() {
+    static thread_local PTR(TraceBuffer) buffer;
+    if (buffer == nullptr) {
+        buffer = NEW(TraceBuffer)();
+        std::lock_guard<std::mutex> hold(buffers_lock);
+        buffer->tid = (int)buffers.size() + 1;
+        buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void record(EventKind kind, int var, PTR(ParamList) params, PTR(Expr) body) {
+    TraceBuffer &buffer = this_thread_buffer();
+    Event event = {kind, var, params, body, now_ns()};
+    if (buffer.events.size() < Trace::capacity) {
+        buffer.events.push_back(event);
+        return;
+    }
+    if (buffer.events.empty())
+        return;
+    buffer.next %= buffer.events.size();
+    buffer.events[buffer.next++] = event;
+    buffer.dropped++;
+}
+
+void Trace::begin_call(PTR(ParamList) params, PTR(Expr) body) {
+    record(begin_call_event, 0, params, body);
+}
+
+void Trace::begin_let(int var_sym, PTR(Expr) body) {
+    record(begin_let_event, var_sym, nullptr, body);
+}
+
+void Trace::end() {
+    record(end_event, 0, nullptr, nullptr);
+}
+
+void Trace::clear() {
+    TraceBuffer &buffer = this_thread_buffer();
+    buffer.events.clear();
+    buffer.next = 0;
+    buffer.dropped = 0;
+}
+
+static std::string label(const Event &event) {
+    if (event.kind == begin_let_event)
+        return "_let " + Symbol::name(event.var);
+    std::string body = event.body->to_string();
+    if (body.size() > 40)
+        body = body.substr(0, 37) + "...";
+    return "_fun " + event.params->to_string() + " " + body;
+}
+
+static std::string json_string(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c < 0x20)
+            c = ' ';
+        out += c;
+    }
+    return out + "\"";
+}
+
+bool Trace::write(const std::string &path) {
+    FILE *json = fopen(path.c_str(), "w");
+    FILE *folded = fopen((path + ".folded").c_str(), "w");
+    if (json == nullptr || folded == nullptr) {
+        if (json != nullptr)
+            fclose(json);
+        if (folded != nullptr)
+            fclose(folded);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> hold(buffers_lock);
+    long long origin = -1;
+    for (PTR(TraceBuffer) buffer : buffers)
+        if (!buffer->events.empty()) {
+            long long first = buffer->events[buffer->next % buffer->events.size()].ts_ns;
+            if (origin < 0 || first < origin)
+                origin = first;
+        }
+
+    fputs("{\"traceEvents\":[", json);
+    bool first_event = true;
+    std::map<std::string, long long> stacks;   // folded stack -> exclusive ns
+    for (PTR(TraceBuffer) buffer : buffers) {
+        std::vector<std::string> stack;
+        size_t n = buffer->events.size();
+        long long last_ns = 0;
+        for (size_t i = 0; i < n; i++) {
+            const Event &event = buffer->events[(buffer->next + i) % n];
+            // an end whose begin was overwritten has nothing to close
+            if (event.kind == end_event && stack.empty())
+                continue;
+
+            if (!stack.empty()) {
+                std::string key;
+                for (const std::string &frame : stack)
+                    key += (key.empty() ? "" : ";") + frame;
+                stacks[key] += event.ts_ns - last_ns;
+            }
+            last_ns = event.ts_ns;
+
+            std::string name;
+            if (event.kind == end_event) {
+                name = stack.back();
+                stack.pop_back();
+            } else {
+                name = label(event);
+                // flamegraph.pl splits frames on ';'
+                std::string frame = name;
+                for (char &c : frame)
+                    if (c == ';')
+                        c = ',';
+                stack.push_back(frame);
+            }
+            fprintf(json, "%s\n{\"name\":%s,\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                    first_event ? "" : ",", json_string(name).c_str(),
+                    event.kind == end_event ? "E" : "B",
+                    (event.ts_ns - origin) / 1000.0, buffer->tid);
+            first_event = false;
+        }
+        if (buffer->dropped > 0)
+            fprintf(stderr, "trace: thread %d dropped its %zu oldest events\n",
+                    buffer->tid, buffer->dropped);
+    }
+    fputs("\n]}\n", json);
+
+    for (auto &stack : stacks)
+        if (stack.second >= 1000)
+            fprintf(folded, "%s %lld\n", stack.first.c_str(), stack.second / 1000);
+
+    bool ok = !ferror(json) && !ferror(folded);
+    ok = fclose(json) == 0 && ok;
+    ok = fclose(folded) == 0 && ok;
+    return ok;
+}
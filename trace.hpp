@@ -0,0 +1,47 @@
+#ifndef trace_hpp
+#define trace_hpp
+
+#include <string>
+
+#include "pointer.hpp"
+
+class Expr;
+class ParamList;
+
+// Call-level trace of a run, turned on with --trace <file>. Each
+// function call and each `_let` body is a span. Events go into a
+// fixed-size ring buffer per thread, keeping the most recent
+// `capacity` of them, and are only formatted when `write` is called.
+//
+// `write` produces Chrome trace-event JSON, for chrome://tracing or
+// Perfetto, and next to it `<file>.folded`, the folded-stack input
+// of flamegraph.pl, weighted by exclusive microseconds.
+class Trace {
+public:
+    static bool enabled;
+    static size_t capacity;
+
+    // Starts the span of calling `_fun params body`
+    static void begin_call(PTR(ParamList) params, PTR(Expr) body);
+    // Starts the span of the body of `_let var = ...`, where `var`
+    // is interned as `var_sym`
+    static void begin_let(int var_sym, PTR(Expr) body);
+    // Ends this thread's innermost span
+    static void end();
+
+    // Writes every thread's events, returning false if the files
+    // can't be written
+    static bool write(const std::string &path);
+
+    // Forgets this thread's events
+    static void clear();
+};
+
+// Ends the innermost span when it goes out of scope, including when
+// evaluation throws
+class TraceSpan {
+public:
+    ~TraceSpan() { Trace::end(); }
+};
+
+#endif /* trace_hpp */
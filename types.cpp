@@ -0,0 +1,291 @@
+#include "types.hpp"
+
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "expr.hpp"
+#include "symbol.hpp"
+
+// A type being inferred. A type variable is solved by pointing its
+// `instance` at what it stands for. Its `level` is the number of
+// `_let` right-hand sides it was made inside; once inference leaves
+// those, a variable deeper than the current level can't be solved
+// any more, and that is what makes it generic.
+class Type REF_COUNTED {
+public:
+    enum Kind { var, num, boolean, fun };
+    Kind kind;
+    int level;                      // for a var
+    PTR(Type) instance;             // for a solved var
+    std::vector<PTR(Type)> params;  // for a fun
+    PTR(Type) result;
+
+    Type(Kind kind, int level = 0);
+};
+
+Type::Type(Kind _kind, int _level) {
+    kind = _kind;
+    level = _level;
+    instance = nullptr;
+    result = nullptr;
+}
+
+// What `t` stands for, following solved variables
+static PTR(Type) resolve(PTR(Type) t) {
+    while (t->kind == Type::var && t->instance != nullptr)
+        t = t->instance;
+    return t;
+}
+
+static std::string show(PTR(Type) t, std::map<Type *, std::string> &names) {
+    t = resolve(t);
+    switch (t->kind) {
+        case Type::num:
+            return "num";
+        case Type::boolean:
+            return "bool";
+        case Type::var: {
+            auto found = names.find(RAW(t));
+            if (found != names.end())
+                return found->second;
+            size_t n = names.size();
+            std::string name = "'" + std::string(1, (char)('a' + n % 26));
+            if (n >= 26)
+                name += std::to_string(n / 26);
+            names[RAW(t)] = name;
+            return name;
+        }
+        case Type::fun: {
+            std::string s = "(";
+            for (size_t i = 0; i < t->params.size(); i++)
+                s += (i == 0 ? "" : ", ") + show(t->params[i], names);
+            return s + ") -> " + show(t->result, names);
+        }
+    }
+    return "";
+}
+
+// Thrown by unify, for the caller to say where
+struct Mismatch {
+    bool infinite;
+};
+
+// Returns whether `var` occurs in `t`, and lowers every variable in
+// `t` to `var`'s level, since `t` is about to appear wherever `var`
+// does
+static bool occurs(Type *var, PTR(Type) t) {
+    t = resolve(t);
+    if (RAW(t) == var)
+        return true;
+    if (t->kind == Type::var) {
+        if (t->level > var->level)
+            t->level = var->level;
+        return false;
+    }
+    for (PTR(Type) const &param : t->params)
+        if (occurs(var, param))
+            return true;
+    return t->kind == Type::fun && occurs(var, t->result);
+}
+
+static void unify(PTR(Type) a, PTR(Type) b) {
+    a = resolve(a);
+    b = resolve(b);
+    if (RAW(a) == RAW(b))
+        return;
+    if (b->kind == Type::var)
+        std::swap(a, b);
+    if (a->kind == Type::var) {
+        if (occurs(RAW(a), b))
+            throw Mismatch{true};
+        a->instance = b;
+        return;
+    }
+    if (a->kind != b->kind || a->params.size() != b->params.size())
+        throw Mismatch{false};
+    for (size_t i = 0; i < a->params.size(); i++)
+        unify(a->params[i], b->params[i]);
+    if (a->kind == Type::fun)
+        unify(a->result, b->result);
+}
+
+//=====================================================
+
+class Inference {
+public:
+    PTR(Type) num = NEW(Type)(Type::num);
+    PTR(Type) boolean = NEW(Type)(Type::boolean);
+    // the types of free variables, by symbol
+    std::unordered_map<int, PTR(Type)> free;
+
+    PTR(Type) infer(PTR(Expr) e);
+
+private:
+    // the variables in scope, innermost last, with their types, which
+    // are generic where they are deeper than `level`
+    std::vector<std::pair<int, PTR(Type)>> scope;
+    int level = 1;
+
+    // Unifies `actual`, the type of `where`, with `expected`
+    void expect(PTR(Expr) where, PTR(Type) actual, PTR(Type) expected);
+    // A copy of `t` with fresh variables for the generic ones
+    PTR(Type) instantiate(PTR(Type) t, std::unordered_map<Type *, PTR(Type)> &copies);
+};
+
+void Inference::expect(PTR(Expr) where, PTR(Type) actual, PTR(Type) expected) {
+    try {
+        unify(actual, expected);
+    } catch (Mismatch &mismatch) {
+        if (mismatch.infinite)
+            throw std::runtime_error("type error: " + where->to_string() + " would have an infinite type");
+        std::map<Type *, std::string> names;
+        throw std::runtime_error("type error: " + where->to_string() + " has type "
+                                 + show(actual, names) + " but needs " + show(expected, names));
+    }
+}
+
+PTR(Type) Inference::instantiate(PTR(Type) t, std::unordered_map<Type *, PTR(Type)> &copies) {
+    t = resolve(t);
+    if (t->kind == Type::var) {
+        if (t->level <= level)
+            return t;
+        auto found = copies.find(RAW(t));
+        if (found != copies.end())
+            return found->second;
+        PTR(Type) copy = NEW(Type)(Type::var, level);
+        copies[RAW(t)] = copy;
+        return copy;
+    }
+    if (t->kind != Type::fun)
+        return t;
+    PTR(Type) copy = NEW(Type)(Type::fun);
+    for (PTR(Type) const &param : t->params)
+        copy->params.push_back(instantiate(param, copies));
+    copy->result = instantiate(t->result, copies);
+    return copy;
+}
+
+PTR(Type) Inference::infer(PTR(Expr) e) {
+    if (CAST(NumExpr)(e) != nullptr)
+        return num;
+    if (CAST(BoolExpr)(e) != nullptr)
+        return boolean;
+
+    if (PTR(VarExpr) v = CAST(VarExpr)(e)) {
+        for (size_t i = scope.size(); i-- > 0; ) {
+            if (scope[i].first == v->sym) {
+                std::unordered_map<Type *, PTR(Type)> copies;
+                return instantiate(scope[i].second, copies);
+            }
+        }
+        // level 0, so it's never generic
+        PTR(Type) &t = free[v->sym];
+        if (t == nullptr)
+            t = NEW(Type)(Type::var, 0);
+        return t;
+    }
+
+    PTR(Expr) lhs = nullptr;
+    PTR(Expr) rhs = nullptr;
+    if (PTR(AddExpr) a = CAST(AddExpr)(e)) {
+        lhs = a->lhs;
+        rhs = a->rhs;
+    } else if (PTR(MultExpr) m = CAST(MultExpr)(e)) {
+        lhs = m->lhs;
+        rhs = m->rhs;
+    }
+    if (lhs != nullptr) {
+        expect(lhs, infer(lhs), num);
+        expect(rhs, infer(rhs), num);
+        return num;
+    }
+
+    if (PTR(CompareExpr) c = CAST(CompareExpr)(e)) {
+        // any two values compare, as at run time
+        infer(c->lhs);
+        infer(c->rhs);
+        return boolean;
+    }
+
+    if (PTR(IfExpr) i = CAST(IfExpr)(e)) {
+        expect(i->condition, infer(i->condition), boolean);
+        PTR(Type) t = infer(i->then_part);
+        expect(i->else_part, infer(i->else_part), t);
+        return t;
+    }
+
+    if (PTR(LetExpr) l = CAST(LetExpr)(e)) {
+        level++;
+        PTR(Type) rhs_type = infer(l->rhs);
+        level--;
+        scope.push_back({l->var_sym, rhs_type});
+        PTR(Type) t = infer(l->body);
+        scope.pop_back();
+        return t;
+    }
+
+    if (PTR(FunExpr) f = CAST(FunExpr)(e)) {
+        PTR(Type) t = NEW(Type)(Type::fun);
+        for (int sym : f->params->syms) {
+            PTR(Type) param = NEW(Type)(Type::var, level);
+            t->params.push_back(param);
+            scope.push_back({sym, param});
+        }
+        t->result = infer(f->body);
+        scope.resize(scope.size() - t->params.size());
+        return t;
+    }
+
+    if (PTR(CallExpr) c = CAST(CallExpr)(e)) {
+        PTR(Type) callee = infer(c->to_be_called);
+        PTR(Type) wanted = NEW(Type)(Type::fun);
+        for (PTR(Expr) const &arg : c->actual_args)
+            wanted->params.push_back(infer(arg));
+        wanted->result = NEW(Type)(Type::var, level);
+        expect(c->to_be_called, callee, wanted);
+        return wanted->result;
+    }
+
+    throw std::runtime_error("type error: unknown expression " + e->to_string());
+}
+
+Typing infer_types(PTR(Expr) e) {
+    Inference inference;
+    PTR(Type) t = inference.infer(e);
+    // one set of names, so that a variable shared between the
+    // program and an input prints the same in both
+    std::map<Type *, std::string> names;
+    Typing typing;
+    typing.type = show(t, names);
+    for (int id : e->free_vars.ids())
+        typing.inputs[Symbol::name(id)] = show(inference.free.at(id), names);
+    return typing;
+}
+
+//=====================================================
+
+PTR(Expr) without_checks(PTR(Expr) e) {
+    if (PTR(AddExpr) a = CAST(AddExpr)(e))
+        return NEW(AddExpr)(without_checks(a->lhs), without_checks(a->rhs), true);
+    if (PTR(MultExpr) m = CAST(MultExpr)(e))
+        return NEW(MultExpr)(without_checks(m->lhs), without_checks(m->rhs), true);
+    if (PTR(CompareExpr) c = CAST(CompareExpr)(e))
+        return NEW(CompareExpr)(without_checks(c->lhs), without_checks(c->rhs));
+    if (PTR(IfExpr) i = CAST(IfExpr)(e))
+        return NEW(IfExpr)(without_checks(i->condition), without_checks(i->then_part),
+                           without_checks(i->else_part), true);
+    if (PTR(LetExpr) l = CAST(LetExpr)(e))
+        return NEW(LetExpr)(l->varStr, l->var_sym, without_checks(l->rhs), without_checks(l->body));
+    if (PTR(FunExpr) f = CAST(FunExpr)(e))
+        return NEW(FunExpr)(f->params, without_checks(f->body));
+    if (PTR(CallExpr) c = CAST(CallExpr)(e)) {
+        PTR(Expr) to_be_called = without_checks(c->to_be_called);
+        std::vector<PTR(Expr)> actual_args;
+        for (PTR(Expr) const &arg : c->actual_args)
+            actual_args.push_back(without_checks(arg));
+        return NEW(CallExpr)(to_be_called, actual_args, true);
+    }
+    return e;
+}
@@ -0,0 +1,40 @@
+#ifndef types_hpp
+#define types_hpp
+
+#include <map>
+#include <string>
+
+#include "pointer.hpp"
+
+class Expr;
+
+// Hindley-Milner type inference. A number has type `num`, a boolean
+// `bool`, and a `_fun` of n parameters `(t1, ..., tn) -> t`; type
+// variables print as 'a, 'b and so on. A function bound by `_let` is
+// generalized, so its uses can be at different types.
+//
+// The types are stricter than evaluation: `_if` needs a boolean
+// condition, though interp also takes numbers, and a function that
+// recurses by applying itself, as in `f(f)`, has no type at all. So
+// typing is optional, and a program that has a type can be run with
+// `without_checks`, while any other still runs with them.
+
+struct Typing {
+    // The type of the whole program
+    std::string type;
+    // The type of each free variable, which is the same at every use
+    std::map<std::string, std::string> inputs;
+};
+
+// Infers the types of `e`. Throws `runtime_error`, starting with
+// "type error", if it has none.
+Typing infer_types(PTR(Expr) e);
+
+// A copy of `e`, which must have a type, whose `+`, `*`, `_if` and
+// calls are marked `typed`: they trust that their operands are the
+// kinds of value they need instead of checking, and call functions
+// without virtual dispatch. The copy evaluates like `e`, provided
+// that its free variables are bound to values of their types.
+PTR(Expr) without_checks(PTR(Expr) e);
+
+#endif /* types_hpp */
@@ -6,9 +6,11 @@
 #include "env.hpp"
 #include "cont.hpp"
 #include "step.hpp"
+#include "memo.hpp"
+#include "trace.hpp"
 
 
-NumVal::NumVal(int _rep) {
+NumVal::NumVal(Number _rep) {
   rep = _rep;
 }
 
@@ -25,7 +27,7 @@ PTR(Val) NumVal::add_to(PTR(Val) other_val) {
   if (other_num_val == nullptr)
     throw std::runtime_error("not a number");
   else
-      return NEW(NumVal)((unsigned) rep + (unsigned) other_num_val->rep);
+      return NEW(NumVal)(rep + other_num_val->rep);
 }
 
 PTR(Val) NumVal::mult_with(PTR(Val) other_val) {
@@ -41,20 +43,20 @@ PTR(Expr) NumVal::to_expr() {
 }
 
 std::string NumVal::to_string() {
-  return std::to_string(rep);
+  return rep.to_string();
 }
 
 bool NumVal::is_true() {
-    if (rep == 0) return false;
+    if (rep.is_zero()) return false;
     else return true;
 }
 
-PTR(Val) NumVal::call(PTR(Val) actual_arg) {
-    return NULL;
+PTR(Val) NumVal::call(PTR(Val) const *actual_args, size_t count) {
+    throw std::runtime_error("not a function");
 }
 
-void NumVal::call_step(PTR(Val) actual_arg_val, PTR(Cont) rest) {
-    
+void NumVal::call_step(const std::vector<PTR(Val)> &actual_arg_vals, PTR(Cont) rest) {
+    throw std::runtime_error("not a function");
 }
 
 //=======================================================================
@@ -94,65 +96,119 @@ bool BoolVal::is_true() {
     return rep;
 }
 
-PTR(Val) BoolVal::call(PTR(Val) actual_arg) {
-    return NULL;
+PTR(Val) BoolVal::call(PTR(Val) const *actual_args, size_t count) {
+    throw std::runtime_error("not a function");
 }
 
-void BoolVal::call_step(PTR(Val) actual_arg_val, PTR(Cont) rest) {
-    
+void BoolVal::call_step(const std::vector<PTR(Val)> &actual_arg_vals, PTR(Cont) rest) {
+    throw std::runtime_error("not a function");
+}
+
+//============================================================
+
+
+ParamList::ParamList(std::vector<std::string> _names) {
+    names = _names;
+    for (const std::string &name : names)
+        syms.push_back(Symbol::intern(name));
+}
+
+std::string ParamList::to_string() {
+    std::string s = "(";
+    for (size_t i = 0; i < names.size(); i++)
+        s += (i == 0 ? "" : ", ") + names[i];
+    return s + ")";
 }
 
 //============================================================
 
+FunVal::FunVal(std::string _formal_arg, PTR(Expr) _body, PTR(Env) _env)
+    : FunVal(NEW(ParamList)(std::vector<std::string>{_formal_arg}), _body, _env) {
+}
 
-FunVal::FunVal(std::string _formal_arg, PTR(Expr) _body, PTR(Env) _env) {
-    formal_arg = _formal_arg;
+FunVal::FunVal(PTR(ParamList) _params, PTR(Expr) _body, PTR(Env) _env) {
+    params = _params;
     body = _body;
     env = _env;
+    serial = Memo::next_serial();
 }
 
 bool FunVal::equals(PTR(Val) val) {
     PTR(FunVal) fv = CAST(FunVal)(val);
     if (fv == NULL)
         return false;
-    return fv->formal_arg == formal_arg && fv->body->equals(body);
+    return fv->params->names == params->names && fv->body->equals(body);
 }
 
 PTR(Val) FunVal::add_to(PTR(Val) other_val) {
-    return body->interp(env)->add_to(other_val);
+    throw std::runtime_error("no adding functions");
 }
 
 PTR(Val) FunVal::mult_with(PTR(Val) other_val) {
-    return body->interp(env)->mult_with(other_val);
+    throw std::runtime_error("no multiplying functions");
 }
 
 PTR(Expr) FunVal::to_expr() {
-    return NEW(FunExpr)(formal_arg, body);
+    return NEW(FunExpr)(params, body);
 }
 
 std::string FunVal::to_string() {
-    return "_fun (" + formal_arg + ") " + body->to_string();
+    return "_fun " + params->to_string() + " " + body->to_string();
 }
 
 bool FunVal::is_true() {
     return false;
 }
 
-PTR(Val) FunVal::call(PTR(Val) actual_arg) {
-    return body -> interp(NEW(ExtendedEnv)(env, formal_arg, actual_arg));
+void FunVal::check_count(size_t count) {
+    if (count != params->names.size())
+        throw std::runtime_error("expected " + std::to_string(params->names.size()) +
+                                 " arguments, got " + std::to_string(count));
+}
+
+PTR(Val) FunVal::call(PTR(Val) const *actual_args, size_t count) {
+    check_count(count);
+    if (serial != 0) {
+        PTR(Val) result = Memo::find(serial, actual_args, count);
+        if (result != nullptr)
+            return result;
+        result = interp_body(actual_args);
+        Memo::remember(serial, actual_args, count, result);
+        return result;
+    }
+    return interp_body(actual_args);
+}
+
+PTR(Val) FunVal::interp_body(PTR(Val) const *actual_args) {
+    // on the stack for the same reason as a `_let`'s frame
+    LOCAL_NEW(CallEnv, frame, env, params, actual_args);
+    if (Trace::enabled) {
+        Trace::begin_call(params, body);
+        TraceSpan span;
+        return body -> interp(frame);
+    }
+    return body -> interp(frame);
+}
+
+
+void FunVal::call_step(const std::vector<PTR(Val)> &actual_arg_vals, PTR(Cont) rest) {
+    check_count(actual_arg_vals.size());
+    if (serial != 0) {
+        PTR(Val) result = Memo::find(serial, actual_arg_vals.data(), actual_arg_vals.size());
+        if (result != nullptr) {
+            Step::machine->mode = Step::continue_mode;
+            Step::machine->val = result;
+            Step::machine->cont = rest;
+            return;
+        }
+        rest = NEW(MemoCont)(serial, actual_arg_vals, rest);
+    }
+    if (Trace::enabled) {
+        Trace::begin_call(params, body);
+        rest = NEW(TraceEndCont)(rest);
+    }
+    Step::machine->mode = Step::interp_mode;
+    Step::machine->expr = body;
+    Step::machine->env = NEW(CallEnv)(env, params, actual_arg_vals.data());
+    Step::machine->cont = rest;
 }
-
-
-void FunVal::call_step(PTR(Val) actual_arg_val, PTR(Cont) rest) {
-    Step::mode = Step::interp_mode;
-    Step::expr = body;
-    Step::env = NEW(ExtendedEnv)(env, formal_arg, actual_arg_val);
-    Step::cont = rest;
-}
-
-
-
-
-
-
-
@@ -2,7 +2,10 @@
 #define value_hpp
 
 #include "pointer.hpp"
+#include "number.hpp"
 #include <string>
+#include <vector>
+#include <stdint.h>
 
 
 
@@ -23,14 +26,27 @@ public :
   virtual PTR(Expr) to_expr() = 0;
   virtual std::string to_string() = 0;
   virtual bool is_true() = 0;
-  virtual PTR(Val) call(PTR(Val) actual_arg) = 0;
-  virtual void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest) = 0;
+  // Calls this with the `count` values at `actual_args`
+  virtual PTR(Val) call(PTR(Val) const *actual_args, size_t count) = 0;
+  virtual void call_step(const std::vector<PTR(Val)> &actual_arg_vals, PTR(Cont) rest) = 0;
+};
+
+// The parameters of a `_fun`, with their symbols. Every closure made
+// from it shares one list.
+class ParamList REF_COUNTED {
+public:
+    std::vector<std::string> names;
+    std::vector<int> syms;
+
+    ParamList(std::vector<std::string> names);
+    // "(a, b, c)"
+    std::string to_string();
 };
 
 class NumVal : public Val {
 public:
-  int rep;
-  NumVal(int rep);
+  Number rep;
+  NumVal(Number rep);
   bool equals(PTR(Val) val);
 
   PTR(Val) add_to(PTR(Val) other_val);
@@ -38,8 +54,8 @@ public:
   PTR(Expr) to_expr();
   std::string to_string();
   bool is_true();
-    PTR(Val) call(PTR(Val) actual_arg);
-    void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest);
+    PTR(Val) call(PTR(Val) const *actual_args, size_t count);
+    void call_step(const std::vector<PTR(Val)> &actual_arg_vals, PTR(Cont) rest);
 };
 
 class BoolVal : public Val {
@@ -53,16 +69,18 @@ public:
   PTR(Expr) to_expr();
   std::string to_string();
   bool is_true();
-    PTR(Val) call(PTR(Val) actual_arg);
-    void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest);
+    PTR(Val) call(PTR(Val) const *actual_args, size_t count);
+    void call_step(const std::vector<PTR(Val)> &actual_arg_vals, PTR(Cont) rest);
 };
 
 class FunVal : public Val {
 public:
-    std::string formal_arg;
+    PTR(ParamList) params;
     PTR(Expr) body;
     PTR(Env) env;
+    uint64_t serial;   // identifies this closure for Memo, or 0
     FunVal(std::string formal_arg, PTR(Expr) body, PTR(Env) env);
+    FunVal(PTR(ParamList) params, PTR(Expr) body, PTR(Env) env);
     bool equals(PTR(Val) val);
     
     PTR(Val) add_to(PTR(Val) other_val);
@@ -70,8 +88,13 @@ public:
     PTR(Expr) to_expr();
     std::string to_string();
     bool is_true();
-    PTR(Val) call(PTR(Val) actual_arg);
-    void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest);
+    PTR(Val) call(PTR(Val) const *actual_args, size_t count);
+    void call_step(const std::vector<PTR(Val)> &actual_arg_vals, PTR(Cont) rest);
+
+private:
+    void check_count(size_t count);
+    // Evaluates the body with the arguments bound, without memoizing
+    PTR(Val) interp_body(PTR(Val) const *actual_args);
 };
 
 #endif /* value_hpp */